@@ -1,8 +1,93 @@
 #include "audio/AlsaDriver.h"
 
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include <poll.h>
+
 namespace linearseq {
 
-AlsaDriver::AlsaDriver() : seq_(nullptr), outPort_(-1), inPort_(-1) {}
+namespace {
+
+// Fills the type and data of ev from a channel event; returns false for unsupported statuses.
+bool setChannelEvent(snd_seq_event_t& ev, const MidiEvent& event) {
+	switch (event.status) {
+		case MidiStatus::NoteOn:
+			snd_seq_ev_set_noteon(&ev, event.channel, event.data1, event.data2);
+			return true;
+		case MidiStatus::NoteOff:
+			snd_seq_ev_set_noteoff(&ev, event.channel, event.data1, event.data2);
+			return true;
+		case MidiStatus::ControlChange:
+			snd_seq_ev_set_controller(&ev, event.channel, event.data1, event.data2);
+			return true;
+		case MidiStatus::ProgramChange:
+			snd_seq_ev_set_pgmchange(&ev, event.channel, event.data1);
+			return true;
+		case MidiStatus::PitchBend:
+			snd_seq_ev_set_pitchbend(&ev, event.channel, ((event.data2 << 7) | event.data1) - 8192);
+			return true;
+		default:
+			return false;
+	}
+}
+
+// Fills the type and data of ev from a system realtime or song position message.
+bool setSystemEvent(snd_seq_event_t& ev, const MidiEvent& event) {
+	switch (event.status) {
+		case MidiStatus::TimingClock:
+			ev.type = SND_SEQ_EVENT_CLOCK;
+			break;
+		case MidiStatus::Start:
+			ev.type = SND_SEQ_EVENT_START;
+			break;
+		case MidiStatus::Continue:
+			ev.type = SND_SEQ_EVENT_CONTINUE;
+			break;
+		case MidiStatus::Stop:
+			ev.type = SND_SEQ_EVENT_STOP;
+			break;
+		case MidiStatus::SongPosition:
+			ev.type = SND_SEQ_EVENT_SONGPOS;
+			ev.data.control.value = (event.data2 << 7) | event.data1;
+			break;
+		default:
+			return false;
+	}
+	snd_seq_ev_set_fixed(&ev);
+	return true;
+}
+
+bool subscribePort(snd_seq_t* seq, int srcPort, int destClient, int destPort) {
+	snd_seq_port_subscribe_t* sub;
+	snd_seq_port_subscribe_alloca(&sub);
+	snd_seq_addr_t sender, dest;
+	sender.client = snd_seq_client_id(seq);
+	sender.port = srcPort;
+	dest.client = destClient;
+	dest.port = destPort;
+	snd_seq_port_subscribe_set_sender(sub, &sender);
+	snd_seq_port_subscribe_set_dest(sub, &dest);
+	return snd_seq_subscribe_port(seq, sub) == 0;
+}
+
+unsigned int tempoMicrosPerQuarter(double bpm) {
+	return static_cast<unsigned int>(std::lround(60000000.0 / bpm));
+}
+
+} // namespace
+
+AlsaDriver::AlsaDriver()
+	: seq_(nullptr),
+	  outPort_(-1),
+	  destinationCount_(0),
+	  destinationPort_(-1),
+	  batching_(false),
+	  inPort_(-1),
+	  clockPort_(-1),
+	  queue_(-1),
+	  queueRunning_(false) {}
 
 AlsaDriver::~AlsaDriver() {
 	close();
@@ -33,12 +118,27 @@ bool AlsaDriver::open() {
 		SND_SEQ_PORT_TYPE_MIDI_GENERIC | SND_SEQ_PORT_TYPE_APPLICATION
 	);
 
-	if (outPort_ < 0 || inPort_ < 0) {
+	clockPort_ = snd_seq_create_simple_port(
+		seq_,
+		"LinearSeq Clock",
+		SND_SEQ_PORT_CAP_READ | SND_SEQ_PORT_CAP_SUBS_READ,
+		SND_SEQ_PORT_TYPE_MIDI_GENERIC | SND_SEQ_PORT_TYPE_APPLICATION
+	);
+
+	if (outPort_ < 0 || inPort_ < 0 || clockPort_ < 0) {
 		snd_seq_close(seq_);
 		seq_ = nullptr;
 		return false;
 	}
 
+	// Optional: without a queue only direct output is available.
+	queue_ = snd_seq_alloc_named_queue(seq_, "LinearSeq");
+
+	destinations_[0] = {-1, -1, outPort_};
+	destinationCount_.store(1, std::memory_order_release);
+	destinationPort_ = outPort_;
+	batching_ = false;
+
 	return true;
 }
 
@@ -46,10 +146,18 @@ void AlsaDriver::close() {
 	if (!seq_) {
 		return;
 	}
+	stopQueue();
+	if (queue_ >= 0) {
+		snd_seq_free_queue(seq_, queue_);
+	}
 	snd_seq_close(seq_);
 	seq_ = nullptr;
 	outPort_ = -1;
+	destinationCount_.store(0, std::memory_order_release);
+	destinationPort_ = -1;
 	inPort_ = -1;
+	clockPort_ = -1;
+	queue_ = -1;
 }
 
 bool AlsaDriver::isOpen() const {
@@ -130,7 +238,19 @@ bool AlsaDriver::connectOutput(int destClient, int destPort) {
 	// Let's implement a quick "disconnect all from outPort" logic if possible, 
 	// but it's complex. Let's stick to "Connect" for now.
 	
-	return snd_seq_subscribe_port(seq_, sub) == 0;
+	if (snd_seq_subscribe_port(seq_, sub) != 0) {
+		return false;
+	}
+	// Clock only flows when enabled in the sequencer, so the device can always be subscribed.
+	connectClockOutput(destClient, destPort);
+	return true;
+}
+
+bool AlsaDriver::connectClockOutput(int destClient, int destPort) {
+	if (!seq_) {
+		return false;
+	}
+	return subscribePort(seq_, clockPort_, destClient, destPort);
 }
 
 bool AlsaDriver::sendNoteOn(uint8_t channel, uint8_t note, uint8_t velocity) {
@@ -139,11 +259,8 @@ bool AlsaDriver::sendNoteOn(uint8_t channel, uint8_t note, uint8_t velocity) {
 	}
 	snd_seq_event_t ev;
 	snd_seq_ev_clear(&ev);
-	snd_seq_ev_set_source(&ev, outPort_);
-	snd_seq_ev_set_subs(&ev);
-	snd_seq_ev_set_direct(&ev);
 	snd_seq_ev_set_noteon(&ev, channel, note, velocity);
-	return snd_seq_event_output_direct(seq_, &ev) >= 0;
+	return sendChannelEvent(ev);
 }
 
 bool AlsaDriver::sendNoteOff(uint8_t channel, uint8_t note, uint8_t velocity) {
@@ -152,11 +269,8 @@ bool AlsaDriver::sendNoteOff(uint8_t channel, uint8_t note, uint8_t velocity) {
 	}
 	snd_seq_event_t ev;
 	snd_seq_ev_clear(&ev);
-	snd_seq_ev_set_source(&ev, outPort_);
-	snd_seq_ev_set_subs(&ev);
-	snd_seq_ev_set_direct(&ev);
 	snd_seq_ev_set_noteoff(&ev, channel, note, velocity);
-	return snd_seq_event_output_direct(seq_, &ev) >= 0;
+	return sendChannelEvent(ev);
 }
 
 bool AlsaDriver::sendControlChange(uint8_t channel, uint8_t controller, uint8_t value) {
@@ -165,11 +279,8 @@ bool AlsaDriver::sendControlChange(uint8_t channel, uint8_t controller, uint8_t
 	}
 	snd_seq_event_t ev;
 	snd_seq_ev_clear(&ev);
-	snd_seq_ev_set_source(&ev, outPort_);
-	snd_seq_ev_set_subs(&ev);
-	snd_seq_ev_set_direct(&ev);
 	snd_seq_ev_set_controller(&ev, channel, controller, value);
-	return snd_seq_event_output_direct(seq_, &ev) >= 0;
+	return sendChannelEvent(ev);
 }
 
 bool AlsaDriver::sendProgramChange(uint8_t channel, uint8_t program) {
@@ -178,21 +289,69 @@ bool AlsaDriver::sendProgramChange(uint8_t channel, uint8_t program) {
 	}
 	snd_seq_event_t ev;
 	snd_seq_ev_clear(&ev);
-	snd_seq_ev_set_source(&ev, outPort_);
-	snd_seq_ev_set_subs(&ev);
-	snd_seq_ev_set_direct(&ev);
 	snd_seq_ev_set_pgmchange(&ev, channel, program);
-	return snd_seq_event_output_direct(seq_, &ev) >= 0;
+	return sendChannelEvent(ev);
+}
+
+bool AlsaDriver::sendPitchBend(uint8_t channel, uint8_t lsb, uint8_t msb) {
+	if (!seq_) {
+		return false;
+	}
+	snd_seq_event_t ev;
+	snd_seq_ev_clear(&ev);
+	snd_seq_ev_set_pitchbend(&ev, channel, ((msb << 7) | lsb) - 8192);
+	return sendChannelEvent(ev);
 }
 
 void AlsaDriver::sendAllNotesOff() {
 	if (!seq_) {
 		return;
 	}
-	// Send CC 123 (All Notes Off) on all 16 MIDI channels
-	for (uint8_t channel = 0; channel < 16; ++channel) {
-		sendControlChange(channel, 123, 0);
+	// Send CC 123 (All Notes Off) on all 16 MIDI channels of every destination
+	const int selected = destinationPort_;
+	const size_t count = destinationCount_.load(std::memory_order_acquire);
+	for (size_t i = 0; i < count; ++i) {
+		destinationPort_ = destinations_[i].outPort;
+		for (uint8_t channel = 0; channel < 16; ++channel) {
+			sendControlChange(channel, 123, 0);
+		}
+	}
+	destinationPort_ = selected;
+	flushOutput();
+}
+
+bool AlsaDriver::sendRealtime(MidiStatus status) {
+	if (!seq_) {
+		return false;
+	}
+	MidiEvent event;
+	event.status = status;
+	snd_seq_event_t ev;
+	snd_seq_ev_clear(&ev);
+	if (!setSystemEvent(ev, event)) {
+		return false;
 	}
+	snd_seq_ev_set_source(&ev, clockPort_);
+	snd_seq_ev_set_subs(&ev);
+	snd_seq_ev_set_direct(&ev);
+	return snd_seq_event_output_direct(seq_, &ev) >= 0;
+}
+
+bool AlsaDriver::sendSongPosition(uint16_t sixteenths) {
+	if (!seq_) {
+		return false;
+	}
+	MidiEvent event;
+	event.status = MidiStatus::SongPosition;
+	event.data1 = static_cast<uint8_t>(sixteenths & 0x7F);
+	event.data2 = static_cast<uint8_t>((sixteenths >> 7) & 0x7F);
+	snd_seq_event_t ev;
+	snd_seq_ev_clear(&ev);
+	setSystemEvent(ev, event);
+	snd_seq_ev_set_source(&ev, clockPort_);
+	snd_seq_ev_set_subs(&ev);
+	snd_seq_ev_set_direct(&ev);
+	return snd_seq_event_output_direct(seq_, &ev) >= 0;
 }
 
 bool AlsaDriver::readInputEvent(MidiEvent& event) {
@@ -245,6 +404,24 @@ bool AlsaDriver::readInputEvent(MidiEvent& event) {
 			event.data2 = static_cast<uint8_t>((value >> 7) & 0x7F);
 			return true;
 		}
+		case SND_SEQ_EVENT_SONGPOS:
+			event.status = MidiStatus::SongPosition;
+			event.channel = 0;
+			event.data1 = static_cast<uint8_t>(ev->data.control.value & 0x7F);
+			event.data2 = static_cast<uint8_t>((ev->data.control.value >> 7) & 0x7F);
+			return true;
+		case SND_SEQ_EVENT_CLOCK:
+			event.status = MidiStatus::TimingClock;
+			return true;
+		case SND_SEQ_EVENT_START:
+			event.status = MidiStatus::Start;
+			return true;
+		case SND_SEQ_EVENT_CONTINUE:
+			event.status = MidiStatus::Continue;
+			return true;
+		case SND_SEQ_EVENT_STOP:
+			event.status = MidiStatus::Stop;
+			return true;
 		default:
 			break;
 	}
@@ -252,4 +429,177 @@ bool AlsaDriver::readInputEvent(MidiEvent& event) {
 	return false;
 }
 
+bool AlsaDriver::waitForInput(int timeoutMs) {
+	if (!seq_) {
+		return false;
+	}
+	if (snd_seq_event_input_pending(seq_, 1) > 0) {
+		return true;
+	}
+	const int count = snd_seq_poll_descriptors_count(seq_, POLLIN);
+	if (count <= 0) {
+		return false;
+	}
+	std::vector<pollfd> fds(static_cast<size_t>(count));
+	snd_seq_poll_descriptors(seq_, fds.data(), static_cast<unsigned int>(count), POLLIN);
+	return poll(fds.data(), fds.size(), timeoutMs) > 0;
+}
+
+bool AlsaDriver::startQueue(uint32_t ppqn, double bpm) {
+	if (!seq_ || queue_ < 0 || ppqn == 0 || bpm <= 0.0) {
+		return false;
+	}
+	stopQueue();
+
+	snd_seq_queue_tempo_t* tempo;
+	snd_seq_queue_tempo_alloca(&tempo);
+	snd_seq_queue_tempo_set_tempo(tempo, tempoMicrosPerQuarter(bpm));
+	snd_seq_queue_tempo_set_ppq(tempo, static_cast<int>(ppqn));
+	if (snd_seq_set_queue_tempo(seq_, queue_, tempo) < 0) {
+		return false;
+	}
+
+	// START resets the queue position to tick 0.
+	if (snd_seq_start_queue(seq_, queue_, nullptr) < 0) {
+		return false;
+	}
+	snd_seq_drain_output(seq_);
+	queueRunning_ = true;
+	return true;
+}
+
+void AlsaDriver::stopQueue() {
+	if (!seq_ || queue_ < 0 || !queueRunning_) {
+		return;
+	}
+	// Discard everything not yet delivered: our output buffer and events already
+	// waiting in the kernel queue.
+	snd_seq_drop_output(seq_);
+	snd_seq_remove_events_t* remove;
+	snd_seq_remove_events_alloca(&remove);
+	snd_seq_remove_events_set_queue(remove, queue_);
+	snd_seq_remove_events_set_condition(remove, SND_SEQ_REMOVE_OUTPUT);
+	snd_seq_remove_events(seq_, remove);
+
+	snd_seq_stop_queue(seq_, queue_, nullptr);
+	snd_seq_drain_output(seq_);
+	queueRunning_ = false;
+}
+
+bool AlsaDriver::isQueueRunning() const {
+	return queueRunning_;
+}
+
+uint32_t AlsaDriver::queueTick() const {
+	if (!seq_ || queue_ < 0) {
+		return 0;
+	}
+	snd_seq_queue_status_t* status;
+	snd_seq_queue_status_alloca(&status);
+	if (snd_seq_get_queue_status(seq_, queue_, status) < 0) {
+		return 0;
+	}
+	return snd_seq_queue_status_get_tick_time(status);
+}
+
+bool AlsaDriver::scheduleEvent(const MidiEvent& event) {
+	if (!seq_ || !queueRunning_) {
+		return false;
+	}
+	snd_seq_event_t ev;
+	snd_seq_ev_clear(&ev);
+	if (setChannelEvent(ev, event)) {
+		snd_seq_ev_set_source(&ev, destinationPort_);
+	} else if (setSystemEvent(ev, event)) {
+		snd_seq_ev_set_source(&ev, clockPort_);
+	} else {
+		return false;
+	}
+	snd_seq_ev_set_subs(&ev);
+	snd_seq_ev_schedule_tick(&ev, queue_, 0, event.tick);
+	return snd_seq_event_output(seq_, &ev) >= 0;
+}
+
+bool AlsaDriver::scheduleTempo(uint32_t queueTick, double bpm) {
+	if (!seq_ || !queueRunning_ || bpm <= 0.0) {
+		return false;
+	}
+	snd_seq_event_t ev;
+	snd_seq_ev_clear(&ev);
+	// Addressed to the system timer port, which applies it at queueTick.
+	snd_seq_ev_set_queue_tempo(&ev, queue_, tempoMicrosPerQuarter(bpm));
+	snd_seq_ev_schedule_tick(&ev, queue_, 0, queueTick);
+	return snd_seq_event_output(seq_, &ev) >= 0;
+}
+
+bool AlsaDriver::flushOutput() {
+	if (!seq_) {
+		return false;
+	}
+	return snd_seq_drain_output(seq_) >= 0;
+}
+
+uint16_t AlsaDriver::addDestination(int client, int port) {
+	if (!seq_ || client < 0 || port < 0) {
+		return 0;
+	}
+	if (const uint16_t existing = findDestination(client, port)) {
+		return existing;
+	}
+	const size_t count = destinationCount_.load(std::memory_order_acquire);
+	if (count == MAX_DESTINATIONS) {
+		return 0;
+	}
+	const std::string name = "LinearSeq Out " + std::to_string(client) + ":" + std::to_string(port);
+	const int outPort = snd_seq_create_simple_port(
+		seq_,
+		name.c_str(),
+		SND_SEQ_PORT_CAP_READ | SND_SEQ_PORT_CAP_SUBS_READ,
+		SND_SEQ_PORT_TYPE_MIDI_GENERIC | SND_SEQ_PORT_TYPE_APPLICATION
+	);
+	if (outPort < 0) {
+		return 0;
+	}
+	if (!subscribePort(seq_, outPort, client, port)) {
+		snd_seq_delete_simple_port(seq_, outPort);
+		return 0;
+	}
+	destinations_[count] = {client, port, outPort};
+	destinationCount_.store(count + 1, std::memory_order_release);
+	return static_cast<uint16_t>(count);
+}
+
+uint16_t AlsaDriver::findDestination(int client, int port) const {
+	const size_t count = destinationCount_.load(std::memory_order_acquire);
+	for (size_t i = 1; i < count; ++i) {
+		if (destinations_[i].client == client && destinations_[i].port == port) {
+			return static_cast<uint16_t>(i);
+		}
+	}
+	return 0;
+}
+
+void AlsaDriver::setDestination(uint16_t destination) {
+	destinationPort_ = destination < destinationCount_.load(std::memory_order_acquire)
+		? destinations_[destination].outPort
+		: outPort_;
+}
+
+void AlsaDriver::setBatching(bool batching) {
+	batching_ = batching;
+	if (!batching) {
+		flushOutput();
+	}
+}
+
+bool AlsaDriver::sendChannelEvent(snd_seq_event_t& ev) {
+	snd_seq_ev_set_source(&ev, destinationPort_);
+	snd_seq_ev_set_subs(&ev);
+	snd_seq_ev_set_direct(&ev);
+	if (batching_) {
+		return snd_seq_event_output(seq_, &ev) >= 0;
+	}
+	return snd_seq_event_output_direct(seq_, &ev) >= 0;
+}
+
 } // namespace linearseq
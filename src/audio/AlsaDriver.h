@@ -1,21 +1,24 @@
 #pragma once
 
+#include <array>
+#include <atomic>
 #include <cstdint>
 
 #include <alsa/asoundlib.h>
 
+#include "audio/MidiOutput.h"
 #include "core/Types.h"
 
 namespace linearseq {
 
-class AlsaDriver {
+class AlsaDriver : public MidiOutput {
 public:
 	AlsaDriver();
-	~AlsaDriver();
+	~AlsaDriver() override;
 
 	bool open();
 	void close();
-	bool isOpen() const;
+	bool isOpen() const override;
 	int inputPort() const;
 
 	struct PortInfo {
@@ -24,19 +27,64 @@ public:
 		std::string name;
 	};
 	std::vector<PortInfo> listOutputPorts();
+	// Connects both the note output and the clock port to the destination.
 	bool connectOutput(int destClient, int destPort);
+	// Send MIDI clock to an additional destination (clock and transport messages
+	// leave from their own "LinearSeq Clock" port).
+	bool connectClockOutput(int destClient, int destPort);
 
-	bool sendNoteOn(uint8_t channel, uint8_t note, uint8_t velocity);
-	bool sendNoteOff(uint8_t channel, uint8_t note, uint8_t velocity);
-	bool sendControlChange(uint8_t channel, uint8_t controller, uint8_t value);
-	bool sendProgramChange(uint8_t channel, uint8_t program);
-	void sendAllNotesOff();
+	bool sendNoteOn(uint8_t channel, uint8_t note, uint8_t velocity) override;
+	bool sendNoteOff(uint8_t channel, uint8_t note, uint8_t velocity) override;
+	bool sendControlChange(uint8_t channel, uint8_t controller, uint8_t value) override;
+	bool sendProgramChange(uint8_t channel, uint8_t program) override;
+	bool sendPitchBend(uint8_t channel, uint8_t lsb, uint8_t msb) override;
+	void sendAllNotesOff() override;
+	bool sendRealtime(MidiStatus status) override;
+	bool sendSongPosition(uint16_t sixteenths) override;
 	bool readInputEvent(MidiEvent& event);
+	// Block until input is pending or timeoutMs elapses. Returns true if input is pending.
+	bool waitForInput(int timeoutMs);
+
+	// Queued output: events are timestamped in queue ticks (0 = when startQueue() ran)
+	// and buffered until flushOutput(), so the kernel delivers them on time.
+	bool startQueue(uint32_t ppqn, double bpm) override;
+	void stopQueue() override;
+	bool isQueueRunning() const override;
+	uint32_t queueTick() const override;
+	bool scheduleEvent(const MidiEvent& event) override;
+	bool scheduleTempo(uint32_t queueTick, double bpm) override;
+	bool flushOutput() override;
+
+	// Each destination gets its own output port, subscribed to that client:port.
+	static constexpr size_t MAX_DESTINATIONS = 64;
+	uint16_t addDestination(int client, int port) override;
+	uint16_t findDestination(int client, int port) const override;
+	void setDestination(uint16_t destination) override;
+	void setBatching(bool batching) override;
 
 private:
+	struct Destination {
+		int client = -1;
+		int port = -1;
+		int outPort = -1;
+	};
+
+	// Sends ev from the selected destination's port, buffered while batching.
+	bool sendChannelEvent(snd_seq_event_t& ev);
+
 	snd_seq_t* seq_;
 	int outPort_;
+	// Entry 0 is outPort_. Appended by addDestination() (one caller at a time, with no
+	// output in flight) and published through the count, so the tick thread and
+	// findDestination() read them without locking.
+	std::array<Destination, MAX_DESTINATIONS> destinations_;
+	std::atomic<size_t> destinationCount_;
+	int destinationPort_;
+	bool batching_;
 	int inPort_;
+	int clockPort_;
+	int queue_;
+	bool queueRunning_;
 };
 
 } // namespace linearseq
@@ -0,0 +1,133 @@
+#include "audio/EventLogOutput.h"
+
+#include <algorithm>
+#include <fstream>
+#include <ios>
+
+namespace linearseq {
+
+namespace {
+
+constexpr uint8_t CC_ALL_NOTES_OFF = 123;
+constexpr uint8_t MIDI_CHANNELS = 16;
+
+} // namespace
+
+EventLogOutput::EventLogOutput(const TickSource& source) : source_(source) {}
+
+bool EventLogOutput::isOpen() const {
+	return true;
+}
+
+bool EventLogOutput::sendNoteOn(uint8_t channel, uint8_t note, uint8_t velocity) {
+	return append(MidiStatus::NoteOn, channel, note, velocity);
+}
+
+bool EventLogOutput::sendNoteOff(uint8_t channel, uint8_t note, uint8_t velocity) {
+	return append(MidiStatus::NoteOff, channel, note, velocity);
+}
+
+bool EventLogOutput::sendControlChange(uint8_t channel, uint8_t controller, uint8_t value) {
+	return append(MidiStatus::ControlChange, channel, controller, value);
+}
+
+bool EventLogOutput::sendProgramChange(uint8_t channel, uint8_t program) {
+	return append(MidiStatus::ProgramChange, channel, program, 0);
+}
+
+bool EventLogOutput::sendPitchBend(uint8_t channel, uint8_t lsb, uint8_t msb) {
+	return append(MidiStatus::PitchBend, channel, lsb, msb);
+}
+
+void EventLogOutput::sendAllNotesOff() {
+	for (uint8_t channel = 0; channel < MIDI_CHANNELS; ++channel) {
+		append(MidiStatus::ControlChange, channel, CC_ALL_NOTES_OFF, 0);
+	}
+}
+
+bool EventLogOutput::sendRealtime(MidiStatus status) {
+	return append(status, 0, 0, 0);
+}
+
+bool EventLogOutput::sendSongPosition(uint16_t sixteenths) {
+	return append(MidiStatus::SongPosition, 0,
+		static_cast<uint8_t>(sixteenths & 0x7F), static_cast<uint8_t>((sixteenths >> 7) & 0x7F));
+}
+
+uint16_t EventLogOutput::addDestination(int client, int port) {
+	if (client < 0) {
+		return 0;
+	}
+	std::lock_guard<std::mutex> lock(mutex_);
+	const std::pair<int, int> address(client, port);
+	for (size_t i = 0; i < destinations_.size(); ++i) {
+		if (destinations_[i] == address) {
+			return static_cast<uint16_t>(i + 1);
+		}
+	}
+	destinations_.push_back(address);
+	return static_cast<uint16_t>(destinations_.size());
+}
+
+uint16_t EventLogOutput::findDestination(int client, int port) const {
+	std::lock_guard<std::mutex> lock(mutex_);
+	const auto it = std::find(destinations_.begin(), destinations_.end(), std::make_pair(client, port));
+	return it == destinations_.end() ? 0 : static_cast<uint16_t>(it - destinations_.begin() + 1);
+}
+
+void EventLogOutput::setDestination(uint16_t destination) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	destination_ = destination;
+}
+
+std::vector<EventLogOutput::Entry> EventLogOutput::entries() const {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return entries_;
+}
+
+void EventLogOutput::clear() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	entries_.clear();
+}
+
+void EventLogOutput::write(std::ostream& out) const {
+	std::lock_guard<std::mutex> lock(mutex_);
+	for (const auto& entry : entries_) {
+		out << entry.tick << " " << entry.timeNs << " "
+			<< std::hex << static_cast<int>(entry.status) << std::dec << " "
+			<< static_cast<int>(entry.channel) << " "
+			<< static_cast<int>(entry.data1) << " "
+			<< static_cast<int>(entry.data2) << " ";
+		if (entry.destination == 0 || entry.destination > destinations_.size()) {
+			out << "default\n";
+		} else {
+			const auto& address = destinations_[entry.destination - 1];
+			out << address.first << ":" << address.second << "\n";
+		}
+	}
+}
+
+bool EventLogOutput::writeToFile(const std::string& path) const {
+	std::ofstream file(path, std::ios::trunc);
+	if (!file) {
+		return false;
+	}
+	write(file);
+	return static_cast<bool>(file);
+}
+
+bool EventLogOutput::append(MidiStatus status, uint8_t channel, uint8_t data1, uint8_t data2) {
+	Entry entry;
+	entry.tick = source_.currentTick();
+	entry.timeNs = source_.tempoMap()->tickToNs(entry.tick);
+	entry.status = status;
+	entry.channel = channel;
+	entry.data1 = data1;
+	entry.data2 = data2;
+	std::lock_guard<std::mutex> lock(mutex_);
+	entry.destination = destination_;
+	entries_.push_back(entry);
+	return true;
+}
+
+} // namespace linearseq
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "audio/MidiOutput.h"
+#include "core/TickSource.h"
+
+namespace linearseq {
+
+// MidiOutput that records every message with the tick and tempo-map time it was sent
+// at, for offline rendering (paired with VirtualClock) and deterministic tests.
+class EventLogOutput : public MidiOutput {
+public:
+	struct Entry {
+		uint64_t tick = 0;
+		int64_t timeNs = 0;
+		MidiStatus status = MidiStatus::NoteOn;
+		uint8_t channel = 0;
+		uint8_t data1 = 0;
+		uint8_t data2 = 0;
+		uint16_t destination = 0; // See MidiOutput::addDestination
+	};
+
+	// Timestamps come from source's currentTick() and tempo map; it must outlive this.
+	explicit EventLogOutput(const TickSource& source);
+
+	bool isOpen() const override;
+	bool sendNoteOn(uint8_t channel, uint8_t note, uint8_t velocity) override;
+	bool sendNoteOff(uint8_t channel, uint8_t note, uint8_t velocity) override;
+	bool sendControlChange(uint8_t channel, uint8_t controller, uint8_t value) override;
+	bool sendProgramChange(uint8_t channel, uint8_t program) override;
+	bool sendPitchBend(uint8_t channel, uint8_t lsb, uint8_t msb) override;
+	void sendAllNotesOff() override;
+	bool sendRealtime(MidiStatus status) override;
+	bool sendSongPosition(uint16_t sixteenths) override;
+	// Destinations are only recorded: each distinct client:port gets the next id.
+	uint16_t addDestination(int client, int port) override;
+	uint16_t findDestination(int client, int port) const override;
+	void setDestination(uint16_t destination) override;
+
+	std::vector<Entry> entries() const;
+	void clear();
+
+	// One "tick time_ns status channel data1 data2 destination" line per entry (status
+	// in hex, destination as client:port or "default").
+	void write(std::ostream& out) const;
+	bool writeToFile(const std::string& path) const;
+
+private:
+	bool append(MidiStatus status, uint8_t channel, uint8_t data1, uint8_t data2);
+
+	const TickSource& source_;
+	mutable std::mutex mutex_;
+	std::vector<Entry> entries_;
+	std::vector<std::pair<int, int>> destinations_;
+	uint16_t destination_ = 0;
+};
+
+} // namespace linearseq
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+
+#include "core/Types.h"
+
+namespace linearseq {
+
+// Destination for the Sequencer's playback output. AlsaDriver sends to ALSA;
+// EventLogOutput records the stream for offline rendering and tests.
+// Queued scheduling is optional: the defaults report it as unavailable, and the
+// Sequencer then falls back to direct output.
+class MidiOutput {
+public:
+	virtual ~MidiOutput() = default;
+
+	virtual bool isOpen() const = 0;
+	virtual bool sendNoteOn(uint8_t channel, uint8_t note, uint8_t velocity) = 0;
+	virtual bool sendNoteOff(uint8_t channel, uint8_t note, uint8_t velocity) = 0;
+	virtual bool sendControlChange(uint8_t channel, uint8_t controller, uint8_t value) = 0;
+	virtual bool sendProgramChange(uint8_t channel, uint8_t program) = 0;
+	virtual bool sendPitchBend(uint8_t channel, uint8_t lsb, uint8_t msb) = 0;
+	virtual void sendAllNotesOff() = 0;
+
+	// System realtime (TimingClock, Start, Continue, Stop) and Song Position Pointer
+	// (in 16th notes), sent to clock followers. Optional.
+	virtual bool sendRealtime(MidiStatus /*status*/) { return false; }
+	virtual bool sendSongPosition(uint16_t /*sixteenths*/) { return false; }
+
+	virtual bool startQueue(uint32_t /*ppqn*/, double /*bpm*/) { return false; }
+	virtual void stopQueue() {}
+	virtual bool isQueueRunning() const { return false; }
+	virtual uint32_t queueTick() const { return 0; }
+	// Channel events, or TimingClock for clock followers.
+	virtual bool scheduleEvent(const MidiEvent& /*event*/) { return false; }
+	virtual bool scheduleTempo(uint32_t /*queueTick*/, double /*bpm*/) { return false; }
+	virtual bool flushOutput() { return true; }
+
+	// Routing. Destination 0 is the default output; addDestination() returns the id of
+	// another (an ALSA client:port for AlsaDriver), the same id again for the same
+	// address, or 0 where routing is unsupported. It may create ports, so call it only
+	// while nothing else uses the output (the Sequencer does so with the tick source
+	// stopped). findDestination() only looks up one added before, else returns 0, and
+	// is safe at any time. Sent and scheduled channel events go to the destination
+	// selected last.
+	virtual uint16_t addDestination(int /*client*/, int /*port*/) { return 0; }
+	virtual uint16_t findDestination(int /*client*/, int /*port*/) const { return 0; }
+	virtual void setDestination(uint16_t /*destination*/) {}
+	// While batching, direct sends may be buffered until flushOutput(), so the events of
+	// one tick go out in a single write for every destination.
+	virtual void setBatching(bool /*batching*/) {}
+};
+
+} // namespace linearseq
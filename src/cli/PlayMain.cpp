@@ -0,0 +1,271 @@
+// linearseq-play: plays a .lseq song on an ALSA port, or renders its event stream
+// offline, without the GUI. Shares the engine with the FLTK application.
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "audio/AlsaDriver.h"
+#include "audio/EventLogOutput.h"
+#include "core/Sequencer.h"
+#include "core/VirtualClock.h"
+#include "utils/SongJson.h"
+
+using namespace linearseq;
+
+namespace {
+
+constexpr int POLL_MS = 20;
+
+volatile std::sig_atomic_t interrupted = 0;
+
+void onSignal(int) {
+	interrupted = 1;
+}
+
+struct Options {
+	std::string songPath;
+	std::string port;       // Empty: the song's MIDI device, else the first port
+	std::string renderPath; // Non-empty: render offline ("-" for stdout)
+	std::string statsPath;
+	uint64_t startTick = 0;
+	uint64_t untilTick = TickSource::NO_TICK;
+	bool list = false;
+	bool queued = false;
+};
+
+void usage() {
+	std::fprintf(stderr,
+		"usage: linearseq-play [options] SONG.lseq\n"
+		"       linearseq-play --list\n"
+		"  -p, --port NAME     output port: CLIENT:PORT numbers, or a name as listed by\n"
+		"                      --list (exact, else the first containing NAME)\n"
+		"  -l, --list          list ALSA output ports and exit\n"
+		"  -r, --render FILE   render offline: write \"tick time_ns status channel data1\n"
+		"                      data2 destination\" lines to FILE (- for stdout) instead\n"
+		"                      of playing\n"
+		"  -s, --start TICK    start playing at TICK\n"
+		"  -u, --until TICK    stop at TICK; a looping song plays until interrupted, or\n"
+		"                      renders up to TICK counted across its passes\n"
+		"  -q, --queued        schedule output on an ALSA queue instead of sending directly\n"
+		"      --stats FILE    write clock and dispatch timing stats to FILE when done\n");
+}
+
+bool parseTick(const char* text, uint64_t& tick) {
+	char* end = nullptr;
+	const unsigned long long value = std::strtoull(text, &end, 10);
+	if (end == text || *end != '\0' || text[0] == '-') {
+		return false;
+	}
+	tick = value;
+	return true;
+}
+
+bool parseOptions(int argc, char** argv, Options& options) {
+	for (int i = 1; i < argc; ++i) {
+		const char* arg = argv[i];
+		const bool hasValue = i + 1 < argc;
+		auto is = [arg](const char* shortName, const char* longName) {
+			return (shortName && std::strcmp(arg, shortName) == 0) || std::strcmp(arg, longName) == 0;
+		};
+		if (is("-l", "--list")) {
+			options.list = true;
+		} else if (is("-q", "--queued")) {
+			options.queued = true;
+		} else if (is("-p", "--port") && hasValue) {
+			options.port = argv[++i];
+		} else if (is("-r", "--render") && hasValue) {
+			options.renderPath = argv[++i];
+		} else if (is(nullptr, "--stats") && hasValue) {
+			options.statsPath = argv[++i];
+		} else if (is("-s", "--start") && hasValue) {
+			if (!parseTick(argv[++i], options.startTick)) {
+				std::fprintf(stderr, "linearseq-play: bad start tick '%s'\n", argv[i]);
+				return false;
+			}
+		} else if (is("-u", "--until") && hasValue) {
+			if (!parseTick(argv[++i], options.untilTick)) {
+				std::fprintf(stderr, "linearseq-play: bad end tick '%s'\n", argv[i]);
+				return false;
+			}
+		} else if (arg[0] == '-' && arg[1] != '\0') {
+			std::fprintf(stderr, "linearseq-play: unknown option or missing value: %s\n", arg);
+			return false;
+		} else if (options.songPath.empty()) {
+			options.songPath = arg;
+		} else {
+			std::fprintf(stderr, "linearseq-play: more than one song given\n");
+			return false;
+		}
+	}
+	return options.list || !options.songPath.empty();
+}
+
+// CLIENT:PORT numbers first, then an exact name, then the first name containing it.
+const AlsaDriver::PortInfo* findPort(const std::vector<AlsaDriver::PortInfo>& ports, const std::string& name) {
+	int client = -1;
+	int port = -1;
+	char rest = '\0';
+	if (std::sscanf(name.c_str(), "%d:%d%c", &client, &port, &rest) == 2) {
+		for (const auto& info : ports) {
+			if (info.client == client && info.port == port) {
+				return &info;
+			}
+		}
+	}
+	for (const auto& info : ports) {
+		if (info.name == name) {
+			return &info;
+		}
+	}
+	for (const auto& info : ports) {
+		if (info.name.find(name) != std::string::npos) {
+			return &info;
+		}
+	}
+	return nullptr;
+}
+
+bool writeStats(const Sequencer& sequencer, const std::string& path) {
+	std::ofstream file(path, std::ios::trunc);
+	if (file) {
+		sequencer.clockStats().write(file);
+		file << "\n";
+		sequencer.dispatchStats().write(file);
+	}
+	if (!file) {
+		std::fprintf(stderr, "linearseq-play: could not write stats to %s\n", path.c_str());
+		return false;
+	}
+	return true;
+}
+
+// Plays the song on a VirtualClock as fast as it renders, logging every message.
+int render(const Song& song, const Options& options) {
+	if (song.loopEnabled && options.startTick < song.loopEnd && options.untilTick == TickSource::NO_TICK) {
+		std::fprintf(stderr, "linearseq-play: the song loops; give --until TICK to render it\n");
+		return 1;
+	}
+	VirtualClock clock;
+	EventLogOutput log(clock);
+	Sequencer sequencer;
+	sequencer.setTickSource(&clock);
+	sequencer.setOutput(&log);
+	sequencer.setSong(song);
+	sequencer.play(options.startTick);
+	clock.run(options.untilTick);
+	const int64_t elapsedNs = clock.elapsedNs();
+	// Detached first: the All Notes Off sent by stop() is not part of the song.
+	sequencer.setOutput(nullptr);
+	sequencer.stop();
+
+	bool ok = true;
+	if (options.renderPath == "-") {
+		log.write(std::cout);
+		ok = static_cast<bool>(std::cout.flush());
+	} else {
+		ok = log.writeToFile(options.renderPath);
+	}
+	if (!ok) {
+		std::fprintf(stderr, "linearseq-play: could not write %s\n", options.renderPath.c_str());
+		return 1;
+	}
+	std::fprintf(stderr, "linearseq-play: rendered %zu events, %.3f s\n", log.entries().size(),
+		static_cast<double>(elapsedNs) / 1.0e9);
+	if (!options.statsPath.empty() && !writeStats(sequencer, options.statsPath)) {
+		return 1;
+	}
+	return 0;
+}
+
+// Plays the song in real time until it ends, --until is reached, or SIGINT/SIGTERM.
+int play(const Song& song, const Options& options, AlsaDriver& driver) {
+	const auto ports = driver.listOutputPorts();
+	const std::string name = options.port.empty() ? song.midiDevice : options.port;
+	const AlsaDriver::PortInfo* port = nullptr;
+	if (!name.empty()) {
+		port = findPort(ports, name);
+		if (!port) {
+			std::fprintf(stderr, "linearseq-play: no output port matches '%s' (see --list)\n", name.c_str());
+			return 1;
+		}
+	} else if (!ports.empty()) {
+		port = &ports.front();
+	}
+	if (port) {
+		if (!driver.connectOutput(port->client, port->port)) {
+			std::fprintf(stderr, "linearseq-play: could not connect to %s\n", port->name.c_str());
+			return 1;
+		}
+		std::fprintf(stderr, "linearseq-play: playing to %d:%d %s\n", port->client, port->port, port->name.c_str());
+	} else {
+		std::fprintf(stderr, "linearseq-play: no output ports; connect to the LinearSeq client yourself\n");
+	}
+
+	Sequencer sequencer;
+	sequencer.setDriver(&driver); // Before setSong(): track routes are resolved there
+	sequencer.setOutputMode(options.queued ? Sequencer::OutputMode::Queued : Sequencer::OutputMode::Direct);
+	sequencer.setSong(song);
+
+	std::signal(SIGINT, onSignal);
+	std::signal(SIGTERM, onSignal);
+	sequencer.play(options.startTick);
+	while (!interrupted && sequencer.isPlaying() && !sequencer.shouldStop()) {
+		if (options.untilTick != TickSource::NO_TICK && !song.loopEnabled &&
+				sequencer.currentTick() >= options.untilTick) {
+			break;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(POLL_MS));
+	}
+	sequencer.stop();
+
+	if (!options.statsPath.empty() && !writeStats(sequencer, options.statsPath)) {
+		return 1;
+	}
+	return 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+	Options options;
+	if (!parseOptions(argc, argv, options)) {
+		usage();
+		return 2;
+	}
+
+	if (options.list) {
+		AlsaDriver driver;
+		if (!driver.open()) {
+			std::fprintf(stderr, "linearseq-play: could not open the ALSA sequencer\n");
+			return 1;
+		}
+		for (const auto& port : driver.listOutputPorts()) {
+			std::printf("%3d:%-3d %s\n", port.client, port.port, port.name.c_str());
+		}
+		return 0;
+	}
+
+	Song song;
+	if (!SongJson::loadFromFile(options.songPath, song)) {
+		std::fprintf(stderr, "linearseq-play: could not load %s\n", options.songPath.c_str());
+		return 1;
+	}
+	if (!options.renderPath.empty()) {
+		return render(song, options);
+	}
+
+	AlsaDriver driver;
+	if (!driver.open()) {
+		std::fprintf(stderr, "linearseq-play: could not open the ALSA sequencer\n");
+		return 1;
+	}
+	return play(song, options, driver);
+}
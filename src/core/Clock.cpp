@@ -1,9 +1,96 @@
 #include "core/Clock.h"
 #include "core/Types.h"
 
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <ctime>
+#include <limits>
+#include <utility>
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
 namespace linearseq {
 
-Clock::Clock() : running_(false), bpm_(DEFAULT_BPM), ppqn_(DEFAULT_PPQN), tickCounter_(0) {}
+namespace {
+
+constexpr int64_t NANOS_PER_SECOND = 1000000000;
+// In NextEvent mode the condition variable wait ends this early, and the backend
+// sleeps the remainder so the final wakeup keeps the backend's precision.
+constexpr int64_t WAKE_GUARD_NS = 2000000;
+
+int64_t monotonicNowNs() {
+	timespec ts{};
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return static_cast<int64_t>(ts.tv_sec) * NANOS_PER_SECOND + ts.tv_nsec;
+}
+
+timespec toTimespec(int64_t ns) {
+	timespec ts{};
+	ts.tv_sec = static_cast<time_t>(ns / NANOS_PER_SECOND);
+	ts.tv_nsec = static_cast<long>(ns % NANOS_PER_SECOND);
+	return ts;
+}
+
+void sleepUntilNs(Clock::Backend backend, int timerFd, int64_t deadlineNs) {
+	switch (backend) {
+		case Clock::Backend::TimerFd: {
+			itimerspec spec{};
+			spec.it_value = toTimespec(deadlineNs);
+			if (timerfd_settime(timerFd, TFD_TIMER_ABSTIME, &spec, nullptr) == 0) {
+				uint64_t expirations = 0;
+				while (read(timerFd, &expirations, sizeof(expirations)) < 0 && errno == EINTR) {
+				}
+				return;
+			}
+			// Fall through to clock_nanosleep if the timer could not be armed.
+			[[fallthrough]];
+		}
+		case Clock::Backend::NanoSleep: {
+			const timespec ts = toTimespec(deadlineNs);
+			while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {
+			}
+			return;
+		}
+		case Clock::Backend::SleepUntil:
+		default: {
+			// steady_clock is CLOCK_MONOTONIC on Linux, so the deadline is directly comparable.
+			const auto deadline = std::chrono::steady_clock::time_point(std::chrono::nanoseconds(deadlineNs));
+			std::this_thread::sleep_until(deadline);
+			return;
+		}
+	}
+}
+
+} // namespace
+
+Clock::Clock()
+	: running_(false),
+	  bpm_(DEFAULT_BPM),
+	  ppqn_(DEFAULT_PPQN),
+	  tempoMap_(std::make_shared<TempoMap>()),
+	  tempoVersion_(0),
+	  tickCounter_(0),
+	  instrumented_(true),
+	  mode_(Mode::EveryTick),
+	  catchUp_(CatchUp::Burst),
+	  catchUpThresholdNs_(0),
+	  tickDeadlineNs_(0),
+	  tickMap_(nullptr),
+	  wakeRequested_(false),
+	  seekPending_(false),
+	  seekTick_(0),
+	  anchorSeq_(0),
+	  anchorNs_(0),
+	  anchorTick_(0),
+	  backend_(Backend::NanoSleep),
+	  timerFd_(-1),
+	  syncSource_(SyncSource::Internal),
+	  slaved_(false) {}
 
 Clock::~Clock() {
 	stop();
@@ -13,7 +100,7 @@ void Clock::setBpm(double bpm) {
 	if (bpm <= 0.0) {
 		return;
 	}
-	bpm_.store(bpm, std::memory_order_relaxed);
+	setTempoMap(std::make_shared<TempoMap>(bpm, ppqn()));
 }
 
 double Clock::bpm() const {
@@ -24,62 +111,418 @@ void Clock::setPpqn(uint32_t ppqn) {
 	if (ppqn == 0) {
 		return;
 	}
-	ppqn_.store(ppqn, std::memory_order_relaxed);
+	setTempoMap(std::make_shared<TempoMap>(bpm(), ppqn));
 }
 
 uint32_t Clock::ppqn() const {
 	return ppqn_.load(std::memory_order_relaxed);
 }
 
+void Clock::setTempoMap(std::shared_ptr<const TempoMap> map) {
+	if (!map) {
+		return;
+	}
+	bpm_.store(map->bpmAt(0), std::memory_order_relaxed);
+	ppqn_.store(map->ppqn(), std::memory_order_relaxed);
+	{
+		std::lock_guard<std::mutex> lock(tempoMutex_);
+		tempoMap_ = std::move(map);
+	}
+	tempoVersion_.fetch_add(1, std::memory_order_release);
+	wake();
+}
+
+std::shared_ptr<const TempoMap> Clock::tempoMap() const {
+	std::lock_guard<std::mutex> lock(tempoMutex_);
+	return tempoMap_;
+}
+
+void Clock::setMode(Mode mode) {
+	mode_.store(mode);
+	wake();
+}
+
+Clock::Mode Clock::mode() const {
+	return mode_.load();
+}
+
+void Clock::setCatchUp(CatchUp catchUp, int64_t thresholdNs) {
+	catchUp_ = catchUp;
+	catchUpThresholdNs_ = thresholdNs;
+}
+
+Clock::CatchUp Clock::catchUp() const {
+	return catchUp_;
+}
+
+void Clock::setBackend(Backend backend) {
+	backend_ = backend;
+}
+
+Clock::Backend Clock::backend() const {
+	return backend_;
+}
+
+void Clock::setRealtimeOptions(const RealtimeOptions& options) {
+	realtimeOptions_ = options;
+}
+
+Clock::RealtimeOptions Clock::realtimeOptions() const {
+	return realtimeOptions_;
+}
+
+Clock::RealtimeStatus Clock::realtimeStatus() const {
+	return realtimeStatus_;
+}
+
+void Clock::setSyncSource(SyncSource source) {
+	syncSource_.store(source);
+}
+
+Clock::SyncSource Clock::syncSource() const {
+	return syncSource_.load();
+}
+
+void Clock::receiveMidiClock(int64_t timeNs) {
+	midiSync_.pulse(timeNs);
+	if (slaved_ && isRunning()) {
+		// Deadlines were predicted from the previous pulse; recompute them.
+		wake();
+	}
+}
+
+MidiClockSync& Clock::midiSync() {
+	return midiSync_;
+}
+
+const MidiClockSync& Clock::midiSync() const {
+	return midiSync_;
+}
+
 void Clock::start(uint64_t startTick) {
 	if (running_.exchange(true)) {
 		return;
 	}
 	tickCounter_.store(startTick, std::memory_order_relaxed);
-	thread_ = std::thread(&Clock::runLoop, this);
+	seekPending_.store(false);
+	slaved_.store(syncSource_.load() == SyncSource::MidiClock);
+	{
+		std::lock_guard<std::mutex> lock(wakeMutex_);
+		wakeRequested_ = false;
+	}
+
+	// Resolve the wait backend up front so a missing timerfd degrades to clock_nanosleep.
+	realtimeStatus_.backend = backend_;
+	if (backend_ == Backend::TimerFd) {
+		timerFd_ = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+		if (timerFd_ < 0) {
+			realtimeStatus_.backend = Backend::NanoSleep;
+		}
+	}
+
+	thread_ = std::thread(instrumented_ ? &Clock::runLoop<true> : &Clock::runLoop<false>, this);
+	applyRealtimeOptions(realtimeStatus_);
 }
 
 void Clock::stop() {
 	if (!running_.exchange(false)) {
 		return;
 	}
+	wake();
 	if (thread_.joinable()) {
 		thread_.join();
 	}
+	if (timerFd_ >= 0) {
+		close(timerFd_);
+		timerFd_ = -1;
+	}
+	releaseRealtimeOptions(realtimeStatus_);
 }
 
 bool Clock::isRunning() const {
 	return running_.load();
 }
 
-void Clock::setTickCallback(TickCallback cb) {
-	onTick_ = std::move(cb);
+void Clock::seek(uint64_t tick) {
+	if (!isRunning()) {
+		tickCounter_.store(tick, std::memory_order_relaxed);
+		return;
+	}
+	seekTick_.store(tick, std::memory_order_relaxed);
+	seekPending_.store(true, std::memory_order_release);
+	wake();
+}
+
+void Clock::wake() {
+	{
+		std::lock_guard<std::mutex> lock(wakeMutex_);
+		wakeRequested_ = true;
+	}
+	wakeCv_.notify_one();
+}
+
+void Clock::setTickSink(const TickSink& sink) {
+	sink_ = sink;
+}
+
+void Clock::setInstrumented(bool instrumented) {
+	instrumented_ = instrumented;
+}
+
+bool Clock::instrumented() const {
+	return instrumented_;
+}
+
+const ClockStats& Clock::stats() const {
+	return stats_;
+}
+
+ClockStats& Clock::stats() {
+	return stats_;
+}
+
+void Clock::resetStats() {
+	stats_.reset();
+}
+
+bool Clock::dumpStats(const std::string& path) const {
+	return stats_.dumpToFile(path);
 }
 
 uint64_t Clock::currentTick() const {
-	return tickCounter_.load(std::memory_order_relaxed);
+	if (!isRunning() || !eventDriven()) {
+		return tickCounter_.load(std::memory_order_relaxed);
+	}
+
+	int64_t anchorNs = 0;
+	uint64_t anchorTick = 0;
+	uint32_t seq = 0;
+	do {
+		seq = anchorSeq_.load(std::memory_order_acquire);
+		anchorNs = anchorNs_.load(std::memory_order_relaxed);
+		anchorTick = anchorTick_.load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+	} while ((seq & 1) != 0 || seq != anchorSeq_.load(std::memory_order_relaxed));
+
+	const auto map = tempoMap();
+	const int64_t elapsed = monotonicNowNs() - anchorNs;
+	return std::max(anchorTick, map->nsToTick(map->tickToNs(anchorTick) + elapsed));
+}
+
+int64_t Clock::tickLatenessNs() const {
+	return std::max<int64_t>(0, monotonicNowNs() - tickDeadlineNs_);
+}
+
+int64_t Clock::tickLatenessNs(uint64_t tick) const {
+	const uint64_t current = tickCounter_.load(std::memory_order_relaxed);
+	if (!tickMap_ || tick >= current) {
+		return tickLatenessNs();
+	}
+	const int64_t deadlineNs = tickDeadlineNs_ - (tickMap_->tickToNs(current) - tickMap_->tickToNs(tick));
+	return std::max<int64_t>(0, monotonicNowNs() - deadlineNs);
+}
+
+void Clock::publishAnchor(int64_t anchorNs, uint64_t anchorTick) {
+	const uint32_t seq = anchorSeq_.load(std::memory_order_relaxed);
+	anchorSeq_.store(seq + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	anchorNs_.store(anchorNs, std::memory_order_relaxed);
+	anchorTick_.store(anchorTick, std::memory_order_relaxed);
+	anchorSeq_.store(seq + 2, std::memory_order_release);
+}
+
+bool Clock::eventDriven() const {
+	return !slaved_ && mode_.load(std::memory_order_relaxed) == Mode::NextEvent;
+}
+
+bool Clock::waitUntil(int64_t deadlineNs) {
+	// Following MIDI Clock also waits interruptibly: each pulse re-predicts the deadline.
+	if (!slaved_ && mode_.load(std::memory_order_relaxed) == Mode::EveryTick) {
+		sleepUntilNs(realtimeStatus_.backend, timerFd_, deadlineNs);
+		return true;
+	}
+
+	{
+		std::unique_lock<std::mutex> lock(wakeMutex_);
+		const auto woken = [this] { return wakeRequested_; };
+		if (deadlineNs == std::numeric_limits<int64_t>::max()) {
+			wakeCv_.wait(lock, woken);
+		} else if (deadlineNs - WAKE_GUARD_NS > monotonicNowNs()) {
+			const auto coarse = std::chrono::steady_clock::time_point(
+				std::chrono::nanoseconds(deadlineNs - WAKE_GUARD_NS));
+			wakeCv_.wait_until(lock, coarse, woken);
+		}
+		// Consume the request on every path out of the wait (woken, timed out or not
+		// waited at all), so one wake() ends exactly one wait.
+		if (std::exchange(wakeRequested_, false)) {
+			return false;
+		}
+	}
+
+	sleepUntilNs(realtimeStatus_.backend, timerFd_, deadlineNs);
+	return true;
 }
 
+void Clock::applyRealtimeOptions(RealtimeStatus& status) {
+	status.schedFifo = false;
+	status.cpuPinned = false;
+	status.memoryLocked = false;
+
+	const pthread_t handle = thread_.native_handle();
+
+	if (realtimeOptions_.lockMemory) {
+		status.memoryLocked = mlockall(MCL_CURRENT | MCL_FUTURE) == 0;
+	}
+
+	if (realtimeOptions_.cpu >= 0 && realtimeOptions_.cpu < CPU_SETSIZE) {
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		CPU_SET(realtimeOptions_.cpu, &cpus);
+		status.cpuPinned = pthread_setaffinity_np(handle, sizeof(cpus), &cpus) == 0;
+	}
+
+	if (realtimeOptions_.schedFifo) {
+		sched_param param{};
+		param.sched_priority = std::clamp(
+			realtimeOptions_.priority,
+			sched_get_priority_min(SCHED_FIFO),
+			sched_get_priority_max(SCHED_FIFO));
+		// EPERM without CAP_SYS_NICE / rtprio limits: stay on SCHED_OTHER.
+		status.schedFifo = pthread_setschedparam(handle, SCHED_FIFO, &param) == 0;
+	}
+}
+
+void Clock::releaseRealtimeOptions(const RealtimeStatus& status) {
+	if (status.memoryLocked) {
+		munlockall();
+	}
+}
+
+template <bool Instrumented>
 void Clock::runLoop() {
-	using clock = std::chrono::steady_clock;
+	std::shared_ptr<const TempoMap> map = tempoMap();
+	uint64_t version = tempoVersion_.load(std::memory_order_acquire);
+
 	uint64_t tick = tickCounter_.load(std::memory_order_relaxed);
-	auto next = clock::now();
+	uint64_t lastTick = tick;
+	bool fired = false;
+
+	// Each deadline is computed directly from the anchor and the tick's exact map time,
+	// so nothing accumulates per tick. The anchor only moves on seek and tempo map change.
+	int64_t anchorNs = monotonicNowNs();
+	uint64_t anchorTick = tick;
+	int64_t anchorMapNs = map->tickToNs(anchorTick);
+	publishAnchor(anchorNs, anchorTick);
+
+	const auto rebase = [&](uint64_t atTick) {
+		anchorTick = atTick;
+		anchorMapNs = map->tickToNs(atTick);
+		publishAnchor(anchorNs, anchorTick);
+	};
+
+	const auto deadlineFor = [&](uint64_t t) {
+		if (t == NO_TICK) {
+			return std::numeric_limits<int64_t>::max();
+		}
+		if (slaved_) {
+			const double pulse = static_cast<double>(t) * MidiClockSync::PULSES_PER_QUARTER / map->ppqn();
+			return midiSync_.deadlineNs(pulse);
+		}
+		return anchorNs + (map->tickToNs(t) - anchorMapNs);
+	};
+	int64_t next = slaved_ ? deadlineFor(tick) : anchorNs;
+	// Compress: earliest time for the next tick while working through a backlog.
+	const bool compress = catchUp_ == CatchUp::Compress && !slaved_;
+	int64_t pacedNs = 0;
 
 	while (running_.load()) {
-		const double bpm = bpm_.load(std::memory_order_relaxed);
-		const uint32_t ppqn = ppqn_.load(std::memory_order_relaxed);
-		const double ticksPerSecond = (bpm / 60.0) * static_cast<double>(ppqn);
-		const auto tickDuration = std::chrono::duration<double>(1.0 / ticksPerSecond);
+		const bool reached = waitUntil(std::max(next, pacedNs));
+		if (!running_.load()) {
+			break;
+		}
+
+		if (seekPending_.exchange(false, std::memory_order_acquire)) {
+			tick = seekTick_.load(std::memory_order_relaxed);
+			anchorNs = monotonicNowNs();
+			rebase(tick);
+			next = slaved_ ? deadlineFor(tick) : anchorNs;
+			pacedNs = 0;
+			fired = false;
+			continue;
+		}
+
+		const uint64_t newVersion = tempoVersion_.load(std::memory_order_acquire);
+		if (newVersion != version) {
+			// Rebase at the position reached under the old map, then follow the new one.
+			const int64_t now = monotonicNowNs();
+			const uint64_t reachedTick = reached
+				? tick
+				: std::max(lastTick, map->nsToTick(anchorMapNs + (now - anchorNs)));
+			anchorNs += map->tickToNs(reachedTick) - anchorMapNs;
+			map = tempoMap();
+			version = newVersion;
+			rebase(reachedTick);
+		}
+
+		if (!reached) {
+			// Woken early: the consumer's schedule may have changed, so ask again.
+			if (fired) {
+				tick = lastTick + 1;
+				if (eventDriven() && sink_.nextTick) {
+					tick = std::max(tick, sink_.nextTick(sink_.context, lastTick));
+				}
+			}
+			next = deadlineFor(tick);
+			continue;
+		}
 
-		next += std::chrono::duration_cast<clock::duration>(tickDuration);
+		int64_t wokeNs = 0;
+		if constexpr (Instrumented) {
+			wokeNs = monotonicNowNs();
+			const int64_t lateness = std::max<int64_t>(0, wokeNs - next);
+			stats_.wakeLateness.record(static_cast<uint64_t>(lateness));
+			if (lateness > static_cast<int64_t>(ClockStats::LATE_WAKEUP_NS)) {
+				stats_.lateWakeups.fetch_add(1, std::memory_order_relaxed);
+			}
+		}
 
 		tickCounter_.store(tick, std::memory_order_relaxed);
-		if (onTick_) {
-			onTick_(tick);
+		tickDeadlineNs_ = next;
+		tickMap_ = map.get();
+		if (sink_.onTick) {
+			sink_.onTick(sink_.context, tick);
+		}
+		lastTick = tick;
+		fired = true;
+
+		int64_t doneNs = 0;
+		if constexpr (Instrumented) {
+			doneNs = monotonicNowNs();
+			stats_.callbackDuration.record(static_cast<uint64_t>(doneNs - wokeNs));
 		}
-		++tick;
 
-		std::this_thread::sleep_until(next);
+		if (eventDriven() && sink_.nextTick) {
+			tick = std::max(tick + 1, sink_.nextTick(sink_.context, tick));
+		} else {
+			++tick;
+		}
+		next = deadlineFor(tick);
+		if (compress) {
+			// More than the threshold behind: the next tick comes no sooner than its
+			// tempo interval divided by COMPRESS_RATE, rather than straight away.
+			const int64_t now = Instrumented ? doneNs : monotonicNowNs();
+			pacedNs = 0;
+			if (now - next > catchUpThresholdNs_) {
+				pacedNs = now + (map->tickToNs(tick) - map->tickToNs(lastTick)) / COMPRESS_RATE;
+				stats_.compressedTicks.fetch_add(1, std::memory_order_relaxed);
+			}
+		}
+
+		if constexpr (Instrumented) {
+			if (doneNs > next) {
+				stats_.overruns.fetch_add(1, std::memory_order_relaxed);
+			}
+		}
 	}
 }
 
@@ -2,40 +2,174 @@
 
 #include <atomic>
 #include <chrono>
-#include <functional>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
 #include <thread>
 
+#include "core/MidiClockSync.h"
+#include "core/TempoMap.h"
+#include "core/TickSource.h"
+#include "core/TimingStats.h"
+
 namespace linearseq {
 
-class Clock {
+class Clock : public TickSource {
 public:
-	using TickCallback = std::function<void(uint64_t)>;
+	// EveryTick wakes once per tick. NextEvent sleeps straight to the tick returned by the
+	// NextTickQuery and only wakes early on tempo change, seek, wake() or stop().
+	enum class Mode {
+		EveryTick,
+		NextEvent
+	};
+
+	// How the clock thread waits for the next tick deadline.
+	enum class Backend {
+		SleepUntil, // std::this_thread::sleep_until on steady_clock (portable fallback)
+		NanoSleep,  // clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME)
+		TimerFd     // absolute timerfd on CLOCK_MONOTONIC
+	};
+
+	// Optional realtime tuning for the clock thread. Each option is best-effort:
+	// if the process lacks the privilege, the clock keeps running without it.
+	struct RealtimeOptions {
+		bool schedFifo = false;
+		int priority = 80;      // SCHED_FIFO priority (clamped to the valid range)
+		int cpu = -1;           // Pin the clock thread to this CPU (-1 = no affinity)
+		bool lockMemory = false; // mlockall(MCL_CURRENT | MCL_FUTURE)
+	};
+
+	// Burst delivers overdue ticks back to back as soon as the thread gets to run.
+	// Compress delivers ticks more than the threshold late at COMPRESS_RATE times their
+	// tempo until caught up, spreading the backlog out instead of sending it as one cluster.
+	enum class CatchUp {
+		Burst,
+		Compress
+	};
+	static constexpr int64_t COMPRESS_RATE = 2;
+
+	// Internal runs on the tempo map. MidiClock follows external MIDI Clock: tick deadlines
+	// come from the MidiClockSync loop and the clock stalls when pulses stop arriving.
+	enum class SyncSource {
+		Internal,
+		MidiClock
+	};
+
+	// What was actually applied by the running (or last) clock thread.
+	struct RealtimeStatus {
+		Backend backend = Backend::SleepUntil;
+		bool schedFifo = false;
+		bool cpuPinned = false;
+		bool memoryLocked = false;
+	};
 
 	Clock();
-	~Clock();
+	~Clock() override;
 
+	// setBpm/setPpqn replace the tempo map with a constant tempo.
 	void setBpm(double bpm);
 	double bpm() const;
 
 	void setPpqn(uint32_t ppqn);
 	uint32_t ppqn() const;
 
-	void start(uint64_t startTick = 0);
-	void stop();
-	bool isRunning() const;
+	// Tick deadlines follow the map's precomputed segments; may be changed while running.
+	void setTempoMap(std::shared_ptr<const TempoMap> map) override;
+	std::shared_ptr<const TempoMap> tempoMap() const override;
+
+	void setMode(Mode mode);
+	Mode mode() const;
+
+	// Takes effect on the next start(). Not applied while following MIDI Clock.
+	void setCatchUp(CatchUp catchUp, int64_t thresholdNs);
+	CatchUp catchUp() const;
+
+	// Backend and realtime options take effect on the next start().
+	void setBackend(Backend backend);
+	Backend backend() const;
+	void setRealtimeOptions(const RealtimeOptions& options);
+	RealtimeOptions realtimeOptions() const;
+	RealtimeStatus realtimeStatus() const;
 
-	void setTickCallback(TickCallback cb);
-	uint64_t currentTick() const;
+	// Takes effect on the next start(). Mode is ignored while following MIDI Clock.
+	void setSyncSource(SyncSource source);
+	SyncSource syncSource() const;
+	// Feed one received 0xF8 (CLOCK_MONOTONIC time) to the sync loop.
+	void receiveMidiClock(int64_t timeNs);
+	MidiClockSync& midiSync();
+	const MidiClockSync& midiSync() const;
+
+	void start(uint64_t startTick = 0) override;
+	void stop() override;
+	bool isRunning() const override;
+	void seek(uint64_t tick) override;
+	void wake() override;
+
+	void setTickSink(const TickSink& sink) override;
+	// In NextEvent mode this is interpolated from the wall clock between wakeups.
+	uint64_t currentTick() const override;
+	int64_t tickLatenessNs() const override;
+	int64_t tickLatenessNs(uint64_t tick) const override;
+
+	// Wakeup lateness and callback duration per tick. Lock-free; safe to read while running.
+	// Disabling instrumentation runs a tick loop built without it (takes effect on start()).
+	void setInstrumented(bool instrumented);
+	bool instrumented() const;
+	const ClockStats& stats() const;
+	// For the tick consumer's counters (see ClockStats).
+	ClockStats& stats();
+	void resetStats();
+	bool dumpStats(const std::string& path) const;
 
 private:
+	template <bool Instrumented>
 	void runLoop();
+	bool waitUntil(int64_t deadlineNs);
+	void publishAnchor(int64_t anchorNs, uint64_t anchorTick);
+	bool eventDriven() const;
+	void applyRealtimeOptions(RealtimeStatus& status);
+	void releaseRealtimeOptions(const RealtimeStatus& status);
 
 	std::atomic<bool> running_;
 	std::thread thread_;
 	std::atomic<double> bpm_;
 	std::atomic<uint32_t> ppqn_;
+	mutable std::mutex tempoMutex_;
+	std::shared_ptr<const TempoMap> tempoMap_;
+	std::atomic<uint64_t> tempoVersion_;
 	std::atomic<uint64_t> tickCounter_;
-	TickCallback onTick_;
+	TickSink sink_;
+	bool instrumented_;
+	std::atomic<Mode> mode_;
+	CatchUp catchUp_;
+	int64_t catchUpThresholdNs_;
+	int64_t tickDeadlineNs_; // Of the tick being delivered (clock thread)
+	const TempoMap* tickMap_; // Map tickDeadlineNs_ was computed on (clock thread)
+
+	// Wakeup channel for NextEvent mode
+	std::mutex wakeMutex_;
+	std::condition_variable wakeCv_;
+	bool wakeRequested_;
+	std::atomic<bool> seekPending_;
+	std::atomic<uint64_t> seekTick_;
+
+	// Timing anchor published for currentTick() interpolation (seqlock)
+	std::atomic<uint32_t> anchorSeq_;
+	std::atomic<int64_t> anchorNs_;
+	std::atomic<uint64_t> anchorTick_;
+
+	ClockStats stats_;
+
+	Backend backend_;
+	RealtimeOptions realtimeOptions_;
+	RealtimeStatus realtimeStatus_;
+	int timerFd_;
+
+	std::atomic<SyncSource> syncSource_;
+	std::atomic<bool> slaved_; // syncSource_ as resolved by start()
+	MidiClockSync midiSync_;
 };
 
 } // namespace linearseq
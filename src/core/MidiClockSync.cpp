@@ -0,0 +1,185 @@
+#include "core/MidiClockSync.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+namespace linearseq {
+
+namespace {
+
+constexpr double NANOS_PER_MINUTE = 60.0e9;
+// Tempo range the loop will follow; intervals outside it restart acquisition.
+constexpr double MIN_PERIOD_NS = NANOS_PER_MINUTE / (400.0 * MidiClockSync::PULSES_PER_QUARTER);
+constexpr double MAX_PERIOD_NS = NANOS_PER_MINUTE / (20.0 * MidiClockSync::PULSES_PER_QUARTER);
+
+// Loop gains: fast while acquiring, then narrow to reject jitter. The period gain is
+// the critically damped partner of the phase gain.
+constexpr double ACQUIRE_GAIN = 0.3;
+constexpr double LOCKED_GAIN = 0.1;
+// Locked once the prediction error stays within this fraction of the period for a beat.
+constexpr double LOCK_TOLERANCE = 0.05;
+constexpr double UNLOCK_TOLERANCE = 0.25;
+constexpr uint32_t LOCK_PULSES = MidiClockSync::PULSES_PER_QUARTER;
+// Smoothing of the jitter and phase error figures (per pulse).
+constexpr double STATS_SMOOTHING = 0.05;
+
+double criticalPeriodGain(double phaseGain) {
+	return 2.0 - phaseGain - 2.0 * std::sqrt(1.0 - phaseGain);
+}
+
+} // namespace
+
+MidiClockSync::MidiClockSync() {
+	reset();
+}
+
+void MidiClockSync::reset() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	state_ = State::Idle;
+	running_ = false;
+	pulses_ = 0;
+	lastArrivalNs_ = 0;
+	phaseNs_ = 0;
+	periodNs_ = 0.0;
+	lastSongPulse_ = -1;
+	acquireStartNs_ = 0;
+	inTolerance_ = 0;
+	lockTimeMs_ = 0.0;
+	jitterVar_ = 0.0;
+	phaseErrorVar_ = 0.0;
+	publishEstimate();
+}
+
+void MidiClockSync::pulse(int64_t timeNs) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	track(timeNs);
+	publishEstimate();
+}
+
+void MidiClockSync::track(int64_t timeNs) {
+	++pulses_;
+	if (running_) {
+		++lastSongPulse_;
+	}
+
+	const double interval = static_cast<double>(timeNs - lastArrivalNs_);
+	const bool first = state_ == State::Idle;
+	lastArrivalNs_ = timeNs;
+
+	if (first || interval < MIN_PERIOD_NS || interval > MAX_PERIOD_NS) {
+		// (Re)start acquisition from this pulse; the period is unknown until the next one.
+		state_ = State::Acquiring;
+		phaseNs_ = timeNs;
+		periodNs_ = 0.0;
+		acquireStartNs_ = timeNs;
+		inTolerance_ = 0;
+		return;
+	}
+	if (periodNs_ == 0.0) {
+		phaseNs_ = timeNs;
+		periodNs_ = interval;
+		return;
+	}
+
+	const double predicted = static_cast<double>(phaseNs_) + periodNs_;
+	const double error = static_cast<double>(timeNs) - predicted;
+	const double gain = state_ == State::Locked ? LOCKED_GAIN : ACQUIRE_GAIN;
+	phaseNs_ = static_cast<int64_t>(std::llround(predicted + gain * error));
+	periodNs_ = std::clamp(periodNs_ + criticalPeriodGain(gain) * error, MIN_PERIOD_NS, MAX_PERIOD_NS);
+
+	const double deviation = interval - periodNs_;
+	jitterVar_ += STATS_SMOOTHING * (deviation * deviation - jitterVar_);
+	phaseErrorVar_ += STATS_SMOOTHING * (error * error - phaseErrorVar_);
+
+	const double magnitude = std::abs(error) / periodNs_;
+	if (state_ == State::Locked) {
+		if (magnitude > UNLOCK_TOLERANCE) {
+			state_ = State::Acquiring;
+			acquireStartNs_ = timeNs;
+			inTolerance_ = 0;
+		}
+	} else if (magnitude <= LOCK_TOLERANCE) {
+		if (++inTolerance_ >= LOCK_PULSES) {
+			state_ = State::Locked;
+			lockTimeMs_ = static_cast<double>(timeNs - acquireStartNs_) / 1.0e6;
+		}
+	} else {
+		inTolerance_ = 0;
+	}
+}
+
+void MidiClockSync::locate(uint64_t songPulse) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	lastSongPulse_ = static_cast<int64_t>(songPulse) - 1;
+	publishEstimate();
+}
+
+void MidiClockSync::setTransportRunning(bool running) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	running_ = running;
+	publishEstimate();
+}
+
+uint64_t MidiClockSync::nextSongPulse() const {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return static_cast<uint64_t>(lastSongPulse_ + 1);
+}
+
+int64_t MidiClockSync::deadlineNs(double songPulse) const {
+	// Called for every tick on the realtime clock thread, so read the published copy.
+	bool running = false;
+	int64_t phaseNs = 0;
+	double periodNs = 0.0;
+	int64_t lastSongPulse = 0;
+	uint32_t seq = 0;
+	do {
+		seq = estimateSeq_.load(std::memory_order_acquire);
+		running = estimateRunning_.load(std::memory_order_relaxed);
+		phaseNs = estimatePhaseNs_.load(std::memory_order_relaxed);
+		periodNs = estimatePeriodNs_.load(std::memory_order_relaxed);
+		lastSongPulse = estimateSongPulse_.load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+	} while ((seq & 1) != 0 || seq != estimateSeq_.load(std::memory_order_relaxed));
+
+	const double ahead = songPulse - static_cast<double>(lastSongPulse);
+	if (!running || periodNs == 0.0 || ahead > 2.0) {
+		return std::numeric_limits<int64_t>::max();
+	}
+	return phaseNs + static_cast<int64_t>(std::llround(ahead * periodNs));
+}
+
+void MidiClockSync::publishEstimate() {
+	const uint32_t seq = estimateSeq_.load(std::memory_order_relaxed);
+	estimateSeq_.store(seq + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	estimateRunning_.store(running_, std::memory_order_relaxed);
+	estimatePhaseNs_.store(phaseNs_, std::memory_order_relaxed);
+	estimatePeriodNs_.store(periodNs_, std::memory_order_relaxed);
+	estimateSongPulse_.store(lastSongPulse_, std::memory_order_relaxed);
+	estimateSeq_.store(seq + 2, std::memory_order_release);
+}
+
+MidiClockSync::Status MidiClockSync::status() const {
+	std::lock_guard<std::mutex> lock(mutex_);
+	Status status;
+	status.state = state_;
+	// steady_clock is CLOCK_MONOTONIC on Linux, the same base as the pulse timestamps.
+	const int64_t nowNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+	if (state_ != State::Idle && static_cast<double>(nowNs - lastArrivalNs_) > MAX_PERIOD_NS) {
+		status.state = State::Idle;
+	}
+	status.transportRunning = running_;
+	if (periodNs_ > 0.0) {
+		status.bpm = NANOS_PER_MINUTE / (periodNs_ * PULSES_PER_QUARTER);
+	}
+	status.lockTimeMs = lockTimeMs_;
+	status.jitterMs = std::sqrt(jitterVar_) / 1.0e6;
+	status.phaseErrorMs = std::sqrt(phaseErrorVar_) / 1.0e6;
+	status.pulses = pulses_;
+	return status;
+}
+
+} // namespace linearseq
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+
+namespace linearseq {
+
+// Phase-locked loop that follows incoming MIDI Clock (24 pulses per quarter note).
+// pulse() is fed arrival times from the MIDI input thread; the clock thread asks
+// deadlineNs() when a song pulse position is due. A second-order loop (phase and
+// period correction) smooths input jitter; gains drop once the loop has locked.
+// deadlineNs() takes no lock: the writers publish the estimate it needs as a seqlock.
+class MidiClockSync {
+public:
+	static constexpr uint32_t PULSES_PER_QUARTER = 24;
+
+	enum class State {
+		Idle,      // no clock received (or it stopped arriving)
+		Acquiring, // estimating the pulse period
+		Locked     // phase error has stayed within tolerance for a beat
+	};
+
+	struct Status {
+		State state = State::Idle;
+		bool transportRunning = false;
+		double bpm = 0.0;
+		double lockTimeMs = 0.0;   // first pulse to lock, for the last acquisition
+		double jitterMs = 0.0;     // RMS deviation of input intervals from the period
+		double phaseErrorMs = 0.0; // RMS error of the loop's pulse prediction
+		uint64_t pulses = 0;       // pulses received since reset()
+	};
+
+	MidiClockSync();
+
+	void reset();
+
+	// One 0xF8 received at timeNs (CLOCK_MONOTONIC).
+	void pulse(int64_t timeNs);
+
+	// Transport: the next pulse received is song pulse songPulse (Start = 0,
+	// Song Position Pointer = 6 per 16th note). Song position only advances while running.
+	void locate(uint64_t songPulse);
+	void setTransportRunning(bool running);
+	// Song pulse the next received pulse will be.
+	uint64_t nextSongPulse() const;
+
+	// Predicted arrival time of a (fractional) song pulse. INT64 max when there is no
+	// period estimate yet, the transport is stopped, or the position is more than one
+	// pulse beyond the next expected one: the caller must wait for more input.
+	int64_t deadlineNs(double songPulse) const;
+
+	Status status() const;
+
+private:
+	void track(int64_t timeNs);
+	void publishEstimate(); // With mutex_ held
+
+	mutable std::mutex mutex_;
+	State state_;
+	bool running_;
+	uint64_t pulses_;
+	int64_t lastArrivalNs_;
+	int64_t phaseNs_;   // loop's estimate of the last pulse's time
+	double periodNs_;   // loop's estimate of the pulse period (0 = unknown)
+	int64_t lastSongPulse_; // song pulse of the last received pulse (-1 = before start)
+	int64_t acquireStartNs_;
+	uint32_t inTolerance_;
+	double lockTimeMs_;
+	double jitterVar_;
+	double phaseErrorVar_;
+
+	// Copy of running_, phaseNs_, periodNs_ and lastSongPulse_ for deadlineNs() (seqlock)
+	std::atomic<uint32_t> estimateSeq_{0};
+	std::atomic<bool> estimateRunning_{false};
+	std::atomic<int64_t> estimatePhaseNs_{0};
+	std::atomic<double> estimatePeriodNs_{0.0};
+	std::atomic<int64_t> estimateSongPulse_{-1};
+};
+
+} // namespace linearseq
@@ -0,0 +1,614 @@
+#include "core/PlaybackQueue.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <thread>
+#include <utility>
+
+#include "core/TempoMap.h"
+
+namespace linearseq {
+
+namespace {
+
+constexpr uint32_t NO_VOICE = std::numeric_limits<uint32_t>::max();
+
+bool isNoteEvent(const PlaybackEvent& event) {
+	return event.status == MidiStatus::NoteOn || event.status == MidiStatus::NoteOff;
+}
+
+constexpr uint8_t CHANNEL_MODE_FIRST = 120;
+constexpr uint8_t RESET_ALL_CONTROLLERS = 121;
+
+bool isChased(const PlaybackEvent& event) {
+	return event.status == MidiStatus::ControlChange || event.status == MidiStatus::ProgramChange ||
+		event.status == MidiStatus::PitchBend;
+}
+
+// Stream order within a tick: note-offs before everything else.
+bool earlier(const PlaybackEvent& a, const PlaybackEvent& b) {
+	if (a.absTick != b.absTick) {
+		return a.absTick < b.absTick;
+	}
+	return PlaybackQueue::isNoteOff(a) && !PlaybackQueue::isNoteOff(b);
+}
+
+// Stream order as one integer: tick, then note-offs before everything else.
+uint64_t orderKey(const PlaybackEvent& event, uint64_t tick) {
+	return (tick << 1) | (PlaybackQueue::isNoteOff(event) ? 0 : 1);
+}
+
+uint32_t saturatedTick(uint64_t tick) {
+	return static_cast<uint32_t>(std::min<uint64_t>(tick, PlaybackEvent::MAX_TICK));
+}
+
+// Moves song ticks by output offsets (see PlaybackQueue::build).
+class OffsetShifter {
+public:
+	explicit OffsetShifter(const Song& song) : song_(song), map_(TempoMap::fromSong(song)) {
+		if (song.loopEnabled && song.loopEnd > song.loopStart) {
+			loopStart_ = song.loopStart;
+			loopEnd_ = song.loopEnd;
+		}
+	}
+
+	int64_t offsetNs(const Track& track) const {
+		return std::llround(PlaybackQueue::outputOffsetMs(song_, track) * 1.0e6);
+	}
+
+	// Rounded to whole ticks at the tempo in effect, so off by up to half a tick.
+	// Monotonic in tick, so each item's events stay in order.
+	uint64_t shift(uint64_t tick, int64_t offsetNs) const {
+		const int64_t maxShift = PlaybackQueueBuilder::MAX_SHIFT;
+		const int64_t ticks = std::clamp<int64_t>(
+			std::llround(static_cast<double>(offsetNs) / map_.nsPerTickAt(tick)), -maxShift, maxShift);
+		uint64_t low = 0;
+		uint64_t high = PlaybackEvent::MAX_TICK;
+		// Events stay on their side of the loop bounds, so every pass plays the same.
+		if (loopEnd_ != 0) {
+			if (tick < loopStart_) {
+				high = loopStart_ - 1;
+			} else if (tick < loopEnd_) {
+				low = loopStart_;
+				high = loopEnd_ - 1;
+			} else {
+				low = loopEnd_;
+			}
+		}
+		const int64_t shifted = static_cast<int64_t>(tick) + ticks;
+		return std::clamp<uint64_t>(static_cast<uint64_t>(std::max<int64_t>(shifted, 0)), low, high);
+	}
+
+private:
+	const Song& song_;
+	TempoMap map_;
+	uint64_t loopStart_ = 0;
+	uint64_t loopEnd_ = 0;
+};
+
+uint64_t mix(uint64_t value) {
+	value *= 0x9E3779B97F4A7C15ULL;
+	return value ^ (value >> 32);
+}
+
+// Identifies an item's run. Event channels are ignored: the track's channel is used.
+uint64_t fingerprint(const std::vector<MidiEvent>& events) {
+	uint64_t hash = mix(0xCBF29CE484222325ULL ^ events.size());
+	for (const auto& event : events) {
+		const uint64_t packed = static_cast<uint64_t>(event.tick) |
+			(static_cast<uint64_t>(event.status) << 32) |
+			(static_cast<uint64_t>(event.data1) << 40) |
+			(static_cast<uint64_t>(event.data2) << 48);
+		hash = mix(hash ^ packed);
+		hash = mix(hash ^ event.duration);
+	}
+	return hash;
+}
+
+// Whether a cached run was expanded from these events. Channels are ignored, as above.
+bool sameEvents(const std::vector<MidiEvent>& a, const std::vector<MidiEvent>& b) {
+	return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](const MidiEvent& x, const MidiEvent& y) {
+		return x.tick == y.tick && x.status == y.status && x.data1 == y.data1 && x.data2 == y.data2 &&
+			x.duration == y.duration;
+	});
+}
+
+// Resolves same-pitch overlaps within each track while the merged stream is emitted:
+// the track's latest note-on owns the pitch, and only the owner's note-off (or an
+// explicit one from the song) releases it. Overlaps between tracks are left to
+// playback, which knows which tracks are heard.
+class VoiceResolver {
+public:
+	explicit VoiceResolver(std::vector<PlaybackEvent>& queue) : queue_(queue), owners_(VOICE_SLOTS) {}
+
+	void emit(const PlaybackEvent& event, uint32_t voice) {
+		if (!isNoteEvent(event)) {
+			queue_.push_back(event);
+			return;
+		}
+		std::vector<Owner>& owners = owners_[voiceSlot(event.channel, event.data1)];
+		auto owner = std::find_if(owners.begin(), owners.end(),
+			[&event](const Owner& entry) { return entry.track == event.track; });
+		if (PlaybackQueue::isNoteOff(event)) {
+			if (voice != NO_VOICE && (owner == owners.end() || owner->voice != voice)) {
+				return; // Cut short by a retrigger
+			}
+			if (owner != owners.end()) {
+				*owner = owners.back();
+				owners.pop_back();
+			}
+			queue_.push_back(event);
+			return;
+		}
+		if (owner != owners.end()) {
+			PlaybackEvent retrigger = event;
+			retrigger.status = MidiStatus::NoteOff;
+			retrigger.data2 = 0;
+			queue_.push_back(retrigger);
+			owner->voice = voice;
+		} else {
+			owners.push_back({event.track, voice});
+		}
+		queue_.push_back(event);
+	}
+
+private:
+	struct Owner {
+		uint16_t track;
+		uint32_t voice;
+	};
+
+	std::vector<PlaybackEvent>& queue_;
+	// Tracks holding each voice slot; rarely more than one.
+	std::vector<std::vector<Owner>> owners_;
+};
+
+} // namespace
+
+ChaseState::ChaseState() {
+	for (auto& channel : controllers) {
+		channel.fill(UNSET);
+	}
+	programs.fill(UNSET);
+	bends.fill(BEND_UNSET);
+}
+
+void ChaseState::apply(const PlaybackEvent& event) {
+	const size_t channel = event.channel & 0x0F;
+	switch (event.status) {
+		case MidiStatus::ControlChange:
+			if (event.data1 < CHANNEL_MODE_FIRST) {
+				controllers[channel][event.data1] = event.data2 & 0x7F;
+			} else if (event.data1 == RESET_ALL_CONTROLLERS) {
+				controllers[channel].fill(UNSET);
+				bends[channel] = BEND_UNSET;
+			}
+			break;
+		case MidiStatus::ProgramChange:
+			programs[channel] = event.data1 & 0x7F;
+			break;
+		case MidiStatus::PitchBend:
+			bends[channel] = static_cast<uint16_t>((event.data1 & 0x7F) | ((event.data2 & 0x7F) << 7));
+			break;
+		default:
+			break;
+	}
+}
+
+bool ChaseState::empty() const {
+	for (size_t channel = 0; channel < 16; ++channel) {
+		if (programs[channel] != UNSET || bends[channel] != BEND_UNSET) {
+			return false;
+		}
+		for (const uint8_t value : controllers[channel]) {
+			if (value != UNSET) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+PlaybackSnapshot::PlaybackSnapshot(std::vector<PlaybackEvent> events, uint64_t chaseInterval)
+	: events_(std::move(events)),
+	  voiceOffsets_(VOICE_SLOTS + 1, 0) {
+	// Counting sort of note event indices by voice slot; stable, so stream order holds.
+	for (const auto& event : events_) {
+		if (isNoteEvent(event)) {
+			++voiceOffsets_[voiceSlot(event.channel, event.data1) + 1];
+		}
+	}
+	for (size_t slot = 0; slot < VOICE_SLOTS; ++slot) {
+		voiceOffsets_[slot + 1] += voiceOffsets_[slot];
+	}
+	voiceEvents_.resize(voiceOffsets_[VOICE_SLOTS]);
+	std::vector<uint32_t> fill(voiceOffsets_.begin(), voiceOffsets_.end() - 1);
+	for (size_t i = 0; i < events_.size(); ++i) {
+		if (isNoteEvent(events_[i])) {
+			voiceEvents_[fill[voiceSlot(events_[i].channel, events_[i].data1)]++] = static_cast<uint32_t>(i);
+		}
+		lead_ = std::max<uint32_t>(lead_, static_cast<uint32_t>(std::max(-events_[i].shift, 0)));
+		lag_ = std::max<uint32_t>(lag_, static_cast<uint32_t>(std::max<int>(events_[i].shift, 0)));
+	}
+
+	// One checkpoint at the first event of each interval; a new state copy only when
+	// something was chased since the last one.
+	chaseInterval = std::max<uint64_t>(chaseInterval, 1);
+	chaseStates_.emplace_back();
+	ChaseState state;
+	bool changed = false;
+	uint64_t nextBoundary = 0;
+	for (size_t i = 0; i < events_.size(); ++i) {
+		const PlaybackEvent& event = events_[i];
+		if (event.absTick >= nextBoundary) {
+			if (changed) {
+				chaseStates_.push_back(state);
+				changed = false;
+			}
+			checkpoints_.push_back({i, chaseStates_.size() - 1});
+			nextBoundary = (event.absTick / chaseInterval + 1) * chaseInterval;
+		}
+		if (isChased(event)) {
+			state.apply(event);
+			changed = true;
+		}
+	}
+}
+
+const std::vector<PlaybackEvent>& PlaybackSnapshot::events() const {
+	return events_;
+}
+
+size_t PlaybackSnapshot::indexAt(uint64_t tick) const {
+	auto it = std::lower_bound(events_.begin(), events_.end(), tick,
+		[](const PlaybackEvent& event, uint64_t value) { return event.absTick < value; });
+	return static_cast<size_t>(it - events_.begin());
+}
+
+ChaseState PlaybackSnapshot::chaseStateAt(uint64_t tick) const {
+	const size_t end = indexAt(tick);
+	auto it = std::upper_bound(checkpoints_.begin(), checkpoints_.end(), end,
+		[](size_t value, const Checkpoint& checkpoint) { return value < checkpoint.index; });
+	if (it == checkpoints_.begin()) {
+		return ChaseState();
+	}
+	--it;
+	ChaseState state = chaseStates_[it->state];
+	for (size_t i = it->index; i < end; ++i) {
+		if (isChased(events_[i])) {
+			state.apply(events_[i]);
+		}
+	}
+	return state;
+}
+
+uint32_t PlaybackSnapshot::lead() const {
+	return lead_;
+}
+
+uint32_t PlaybackSnapshot::lag() const {
+	return lag_;
+}
+
+const PlaybackEvent* PlaybackSnapshot::releaseOf(size_t slot, uint64_t tick) const {
+	const auto begin = voiceEvents_.begin() + voiceOffsets_[slot];
+	const auto end = voiceEvents_.begin() + voiceOffsets_[slot + 1];
+	auto it = std::lower_bound(begin, end, tick,
+		[this](uint32_t index, uint64_t value) { return events_[index].absTick < value; });
+	return it != end && PlaybackQueue::isNoteOff(events_[*it]) ? &events_[*it] : nullptr;
+}
+
+void PlaybackSnapshot::setTrackDestinations(std::vector<uint16_t> destinations) {
+	trackDestinations_ = std::move(destinations);
+}
+
+const std::vector<uint16_t>& PlaybackSnapshot::trackDestinations() const {
+	return trackDestinations_;
+}
+
+const PlaybackEvent* PlaybackSnapshot::noteSoundingAt(size_t slot, size_t index, const TrackMask& mask) const {
+	const auto begin = voiceEvents_.begin() + voiceOffsets_[slot];
+	const auto end = std::lower_bound(begin, voiceEvents_.begin() + voiceOffsets_[slot + 1], index);
+	// The last note-on of a heard track holds the voice, unless its own off followed:
+	// any later event of that track is one.
+	for (auto it = end; it != begin;) {
+		const PlaybackEvent& note = events_[*--it];
+		if (PlaybackQueue::isNoteOff(note) || !mask.enabled(note.track)) {
+			continue;
+		}
+		const bool released = std::any_of(it + 1, end,
+			[this, &note](uint32_t later) { return events_[later].track == note.track; });
+		return released ? nullptr : &note;
+	}
+	return nullptr;
+}
+
+void PlaybackQueueBuilder::expand(const MidiItem& item, Run& run) {
+	run.events.clear();
+	run.events.reserve(item.events.size() * 2);
+	run.voices = 0;
+	run.openNotes = 0;
+	for (const auto& event : item.events) {
+		RunEvent entry;
+		entry.event.absTick = event.tick;
+		entry.event.status = event.status;
+		entry.event.data1 = event.data1;
+		entry.event.data2 = event.data2;
+		entry.voice = NO_VOICE;
+		if (event.status != MidiStatus::NoteOn || event.data2 == 0) {
+			run.events.push_back(entry);
+			continue;
+		}
+		entry.voice = run.voices++;
+		run.events.push_back(entry);
+		if (event.duration == 0) {
+			++run.openNotes;
+			continue;
+		}
+		entry.event.absTick = saturatedTick(static_cast<uint64_t>(event.tick) + event.duration);
+		entry.event.status = MidiStatus::NoteOff;
+		entry.event.data2 = 0;
+		run.events.push_back(entry);
+	}
+	std::stable_sort(run.events.begin(), run.events.end(), [](const RunEvent& a, const RunEvent& b) {
+		return earlier(a.event, b.event);
+	});
+}
+
+void PlaybackQueueBuilder::expandAll(const std::vector<StaleRun>& stale, size_t events) const {
+	const size_t threads = events < PARALLEL_MIN_EVENTS ? 1 : std::min(maxThreads_, stale.size());
+	if (threads <= 1) {
+		for (const auto& entry : stale) {
+			expand(*entry.item, *entry.run);
+		}
+		return;
+	}
+	// Items are independent; workers take the next one until none are left.
+	std::atomic<size_t> next(0);
+	auto work = [&stale, &next] {
+		for (size_t i = next.fetch_add(1); i < stale.size(); i = next.fetch_add(1)) {
+			expand(*stale[i].item, *stale[i].run);
+		}
+	};
+	std::vector<std::thread> workers;
+	workers.reserve(threads - 1);
+	for (size_t i = 1; i < threads; ++i) {
+		workers.emplace_back(work);
+	}
+	work();
+	for (auto& worker : workers) {
+		worker.join();
+	}
+}
+
+std::vector<PlaybackEvent> PlaybackQueueBuilder::build(const Song& song) {
+	++generation_;
+	stats_ = Stats();
+
+	bool anySolo = false;
+	for (const auto& track : song.tracks) {
+		if (track.solo) {
+			anySolo = true;
+			break;
+		}
+	}
+
+	// One cursor per item, in song order (track, item), which breaks ties.
+	struct Source {
+		const Run* run = nullptr;
+		size_t position = 0;
+		uint64_t startTick = 0;
+		uint8_t channel = 0;
+		uint16_t track = 0;
+		uint32_t voiceBase = 0;
+		int64_t offsetNs = 0;
+		uint64_t lastTick = 0; // Dispatch tick of the last event taken
+	};
+	const OffsetShifter shifter(song);
+	std::vector<Source> sources;
+	std::vector<StaleRun> stale;
+	size_t staleEvents = 0;
+	for (size_t trackIndex = 0; trackIndex < song.tracks.size(); ++trackIndex) {
+		const Track& track = song.tracks[trackIndex];
+		if (trackIndex >= TrackMask::MAX_TRACKS && (track.mute || (anySolo && !track.solo))) {
+			continue;
+		}
+		const auto tag = static_cast<uint16_t>(std::min<size_t>(trackIndex, std::numeric_limits<uint16_t>::max()));
+		const int64_t offsetNs = shifter.offsetNs(track);
+		for (const auto& item : track.items) {
+			// Unordered_map nodes are stable, so the pointer survives later insertions.
+			uint64_t key = fingerprint(item.events);
+			Run* run = &runs_[key];
+			// A fingerprint shared with a different item of this build: probe the next key.
+			while (run->lastUsed == generation_ && !sameEvents(run->source, item.events)) {
+				run = &runs_[++key];
+			}
+			if (run->lastUsed != generation_ && (run->lastUsed == 0 || !sameEvents(run->source, item.events))) {
+				run->source = item.events;
+				stale.push_back({run, &item});
+				staleEvents += item.events.size();
+			}
+			run->lastUsed = generation_;
+			sources.push_back({run, 0, item.startTick, track.channel, tag, 0, offsetNs, 0});
+		}
+	}
+	for (auto it = runs_.begin(); it != runs_.end();) {
+		it = it->second.lastUsed == generation_ ? std::next(it) : runs_.erase(it);
+	}
+	stats_.items = sources.size();
+	stats_.rebuiltRuns = stale.size();
+	expandAll(stale, staleEvents);
+
+	// Worst case the merged stream adds a retrigger off for every note with no off of its own.
+	size_t capacity = 0;
+	uint32_t voiceBase = 0;
+	sources.erase(std::remove_if(sources.begin(), sources.end(),
+		[](const Source& source) { return source.run->events.empty(); }), sources.end());
+	for (auto& source : sources) {
+		source.voiceBase = voiceBase;
+		voiceBase += source.run->voices;
+		capacity += source.run->events.size() + source.run->openNotes;
+	}
+
+	// Position of a source's next event in stream order; ties go to song order.
+	struct Head {
+		uint64_t key = 0;
+		size_t source = 0;
+
+		bool operator<(const Head& other) const {
+			return key != other.key ? key < other.key : source < other.source;
+		}
+	};
+	// Song tick moved by the track's offset; never before the source's previous event,
+	// so rounding at tempo changes cannot reorder an item.
+	auto dispatchTick = [&shifter](const Source& source, const PlaybackEvent& event) {
+		const uint64_t tick = event.absTick + source.startTick;
+		return source.offsetNs == 0 ? tick : std::max(source.lastTick, shifter.shift(tick, source.offsetNs));
+	};
+	auto headOf = [&sources, &dispatchTick](size_t index) {
+		const Source& source = sources[index];
+		const PlaybackEvent& event = source.run->events[source.position].event;
+		return Head{orderKey(event, dispatchTick(source, event)), index};
+	};
+	auto later = [](const Head& a, const Head& b) { return b < a; };
+
+	// Sources join the heap only once they are next, so the heap holds just the items
+	// overlapping the current position rather than every item in the song.
+	std::vector<Head> pending;
+	pending.reserve(sources.size());
+	for (size_t i = 0; i < sources.size(); ++i) {
+		pending.push_back(headOf(i));
+	}
+	std::sort(pending.begin(), pending.end(), later); // Earliest at the back
+
+	// Min-heap of active sources; the top is replaced in place as it advances.
+	std::vector<Head> heap;
+	heap.reserve(sources.size());
+	auto siftDown = [&heap](size_t index) {
+		const size_t size = heap.size();
+		const Head moving = heap[index];
+		for (;;) {
+			size_t child = 2 * index + 1;
+			if (child >= size) {
+				break;
+			}
+			if (child + 1 < size && heap[child + 1] < heap[child]) {
+				++child;
+			}
+			if (!(heap[child] < moving)) {
+				break;
+			}
+			heap[index] = heap[child];
+			index = child;
+		}
+		heap[index] = moving;
+	};
+
+	std::vector<PlaybackEvent> queue;
+	queue.reserve(capacity);
+	VoiceResolver resolver(queue);
+	while (!heap.empty() || !pending.empty()) {
+		while (!pending.empty() && (heap.empty() || pending.back() < heap.front())) {
+			heap.push_back(pending.back());
+			pending.pop_back();
+			std::push_heap(heap.begin(), heap.end(), later);
+		}
+		Source& source = sources[heap.front().source];
+		const RunEvent& entry = source.run->events[source.position];
+		PlaybackEvent event = entry.event;
+		const uint32_t songTick = saturatedTick(event.absTick + source.startTick);
+		source.lastTick = dispatchTick(source, event);
+		event.absTick = saturatedTick(source.lastTick);
+		event.shift = static_cast<int16_t>(static_cast<int64_t>(event.absTick) - songTick);
+		event.channel = source.channel;
+		event.track = source.track;
+		resolver.emit(event, entry.voice == NO_VOICE ? NO_VOICE : source.voiceBase + entry.voice);
+		if (++source.position == source.run->events.size()) {
+			heap.front() = heap.back();
+			heap.pop_back();
+		} else {
+			heap.front() = headOf(heap.front().source);
+		}
+		if (!heap.empty()) {
+			siftDown(0);
+		}
+	}
+	stats_.events = queue.size();
+	return queue;
+}
+
+TrackMask::TrackMask() : version_(0) {
+	for (auto& word : words_) {
+		word.store(~0ULL, std::memory_order_relaxed);
+	}
+}
+
+void TrackMask::update(const Song& song) {
+	bool anySolo = false;
+	for (const auto& track : song.tracks) {
+		anySolo = anySolo || track.solo;
+	}
+	for (size_t word = 0; word < words_.size(); ++word) {
+		uint64_t bits = ~0ULL;
+		for (size_t bit = 0; bit < 64 && word * 64 + bit < song.tracks.size(); ++bit) {
+			const Track& track = song.tracks[word * 64 + bit];
+			if (track.mute || (anySolo && !track.solo)) {
+				bits &= ~(1ULL << bit);
+			}
+		}
+		words_[word].store(bits, std::memory_order_relaxed);
+	}
+	version_.fetch_add(1, std::memory_order_release);
+}
+
+PlaybackQueueBuilder::PlaybackQueueBuilder()
+	: maxThreads_(std::clamp<size_t>(std::thread::hardware_concurrency(), 1, DEFAULT_MAX_THREADS)) {}
+
+void PlaybackQueueBuilder::setMaxThreads(size_t threads) {
+	maxThreads_ = std::max<size_t>(threads, 1);
+}
+
+size_t PlaybackQueueBuilder::maxThreads() const {
+	return maxThreads_;
+}
+
+const PlaybackQueueBuilder::Stats& PlaybackQueueBuilder::lastStats() const {
+	return stats_;
+}
+
+} // namespace linearseq
+
+namespace linearseq::PlaybackQueue {
+
+bool isNoteOff(const PlaybackEvent& event) {
+	return event.status == MidiStatus::NoteOff ||
+		(event.status == MidiStatus::NoteOn && event.data2 == 0);
+}
+
+std::vector<PlaybackEvent> build(const Song& song) {
+	PlaybackQueueBuilder builder;
+	return builder.build(song);
+}
+
+double outputOffsetMs(const Song& song, const Track& track) {
+	double offsetMs = track.offsetMs;
+	for (const auto& port : song.portOffsets) {
+		if (port.client == track.alsaClient && port.port == track.alsaPort) {
+			offsetMs += port.offsetMs;
+		}
+	}
+	return offsetMs;
+}
+
+double minOutputOffsetMs(const Song& song) {
+	const TempoMap map = TempoMap::fromSong(song);
+	double longestNs = 0.0;
+	for (const auto& segment : map.segments()) {
+		longestNs = std::max(longestNs, map.nsPerTickAt(segment.startTick));
+	}
+	return longestNs / 1.0e6;
+}
+
+} // namespace linearseq::PlaybackQueue
@@ -0,0 +1,232 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "core/Types.h"
+
+namespace linearseq {
+
+// One channel message at an absolute dispatch tick, tagged with the index of the track
+// it came from. Note-offs are explicit events. Packed into 12 bytes so long streams stay
+// small and the tick loop walks them with few cache misses. Song ticks are 32-bit
+// already (item start plus event tick); anything past the range saturates at MAX_TICK.
+// The dispatch tick is the song tick moved by the track's output offset, if any.
+struct PlaybackEvent {
+	static constexpr uint32_t MAX_TICK = 0xFFFFFFFFu;
+
+	uint32_t absTick = 0;
+	MidiStatus status = MidiStatus::NoteOn;
+	uint8_t channel = 0;
+	uint8_t data1 = 0;
+	uint8_t data2 = 0;
+	uint16_t track = 0;
+	int16_t shift = 0; // absTick minus the song tick
+
+	uint32_t songTick() const {
+		return static_cast<uint32_t>(static_cast<int64_t>(absTick) - shift);
+	}
+	bool operator<(const PlaybackEvent& other) const {
+		return absTick < other.absTick;
+	}
+};
+static_assert(sizeof(PlaybackEvent) == 12, "PlaybackEvent should stay packed");
+
+// Which tracks are heard, from the song's mute and solo flags, one bit per track.
+// Updated under the owner's lock and read by the tick thread without locking, so
+// mute/solo changes need no rebuild of the playback stream. Tracks past MAX_TRACKS
+// always read as enabled; the builder applies mute/solo to them instead.
+class TrackMask {
+public:
+	static constexpr size_t MAX_TRACKS = 1024;
+
+	TrackMask();
+
+	void update(const Song& song);
+	// Bumped by every update(), so readers can tell the mask changed.
+	uint64_t version() const {
+		return version_.load(std::memory_order_acquire);
+	}
+	bool enabled(size_t track) const {
+		return track >= MAX_TRACKS ||
+			((words_[track / 64].load(std::memory_order_relaxed) >> (track % 64)) & 1) != 0;
+	}
+
+private:
+	std::array<std::atomic<uint64_t>, MAX_TRACKS / 64> words_;
+	std::atomic<uint64_t> version_;
+};
+
+// One sounding note per MIDI channel and pitch.
+constexpr size_t VOICE_SLOTS = 16 * 128;
+
+inline size_t voiceSlot(uint8_t channel, uint8_t pitch) {
+	return static_cast<size_t>(channel & 0x0F) * 128 + (pitch & 0x7F);
+}
+
+// Channel state a song has set up by some position: the last value of each controller,
+// program and pitch bend per channel, to be sent before playing from there.
+struct ChaseState {
+	static constexpr uint8_t UNSET = 0xFF;
+	static constexpr uint16_t BEND_UNSET = 0xFFFF;
+
+	std::array<std::array<uint8_t, 128>, 16> controllers; // Channel mode messages (120+) excluded
+	std::array<uint8_t, 16> programs;
+	std::array<uint16_t, 16> bends; // 14-bit value, LSB in the low 7 bits
+
+	ChaseState();
+	void apply(const PlaybackEvent& event);
+	bool empty() const;
+};
+
+// Immutable playback stream of a song, built off the realtime thread and handed to
+// the tick thread whole. Also indexes note events per voice so the tick thread can
+// tell, when it switches streams mid-song, which sounding notes the new one releases.
+class PlaybackSnapshot {
+public:
+	static constexpr uint64_t DEFAULT_CHASE_INTERVAL = 4 * 4 * DEFAULT_PPQN;
+
+	// events as produced by PlaybackQueue::build or PlaybackQueueBuilder::build.
+	// Chase state is checkpointed every chaseInterval ticks.
+	explicit PlaybackSnapshot(std::vector<PlaybackEvent> events, uint64_t chaseInterval = DEFAULT_CHASE_INTERVAL);
+
+	const std::vector<PlaybackEvent>& events() const;
+	// Index of the first event at or after tick.
+	size_t indexAt(uint64_t tick) const;
+	// The first note event at or after tick on this voice slot if it is a note-off, i.e.
+	// the off that releases a note left sounding there at tick, or nullptr.
+	const PlaybackEvent* releaseOf(size_t slot, uint64_t tick) const;
+	// The note-on left sounding on this voice slot once the events before index have
+	// played with only the tracks enabled in mask heard, or nullptr.
+	const PlaybackEvent* noteSoundingAt(size_t slot, size_t index, const TrackMask& mask) const;
+	// State set by the events before tick. Starts from the nearest checkpoint, so it
+	// replays at most one interval of events.
+	ChaseState chaseStateAt(uint64_t tick) const;
+	// Largest shift of any event ahead of (lead) and behind (lag) its song tick. Playing
+	// from a song tick starts at indexAt(tick - lead) and skips events whose song tick
+	// is earlier, up to indexAt(tick + lag + 1).
+	uint32_t lead() const;
+	uint32_t lag() const;
+
+	// Output destination (see MidiOutput::addDestination) of each track's events, set by
+	// the owner before publishing. Tracks without one use destination 0.
+	void setTrackDestinations(std::vector<uint16_t> destinations);
+	const std::vector<uint16_t>& trackDestinations() const;
+	uint16_t destinationOf(uint16_t track) const {
+		return track < trackDestinations_.size() ? trackDestinations_[track] : 0;
+	}
+
+	// Link for the owner's list of snapshots awaiting reclamation.
+	PlaybackSnapshot* retiredNext = nullptr;
+
+private:
+	std::vector<PlaybackEvent> events_;
+	// Indices of note events grouped by voice slot, in stream order (CSR layout).
+	std::vector<uint32_t> voiceEvents_;
+	std::vector<uint32_t> voiceOffsets_;
+	// First event index of each checkpointed interval that has events, and the chase
+	// state in effect there. Intervals without chased events share a state.
+	struct Checkpoint {
+		size_t index = 0;
+		size_t state = 0;
+	};
+	std::vector<Checkpoint> checkpoints_;
+	std::vector<ChaseState> chaseStates_;
+	std::vector<uint16_t> trackDestinations_;
+	uint32_t lead_ = 0;
+	uint32_t lag_ = 0;
+};
+
+// Builds playback streams (see PlaybackQueue::build) incrementally. Each item's events
+// are expanded and sorted once into a run, with ticks relative to the item start and
+// keyed by a fingerprint of the events, and reused while unchanged. Moving items or
+// editing a few of them saves the sorting, but every build still fingerprints and
+// compares each item's events and merges the whole stream, so it stays O(song).
+// When many events need sorting (a first build of a large song), items are expanded
+// in parallel on a few short-lived worker threads. Not thread-safe.
+class PlaybackQueueBuilder {
+public:
+	// Below this many events to sort, building stays on the calling thread.
+	static constexpr size_t PARALLEL_MIN_EVENTS = 50000;
+	static constexpr size_t DEFAULT_MAX_THREADS = 4;
+	// Largest output offset applied, either way, in ticks.
+	static constexpr int32_t MAX_SHIFT = 0x7FFF;
+
+	struct Stats {
+		size_t items = 0;       // Items in the last build
+		size_t rebuiltRuns = 0; // Items that had to be expanded and sorted
+		size_t events = 0;      // Events in the resulting stream
+	};
+
+	PlaybackQueueBuilder();
+
+	std::vector<PlaybackEvent> build(const Song& song);
+	const Stats& lastStats() const;
+	// Threads used for large builds, including the caller (default: cores, up to 4).
+	void setMaxThreads(size_t threads);
+	size_t maxThreads() const;
+
+private:
+	struct RunEvent {
+		PlaybackEvent event; // absTick relative to the item start, channel unset
+		uint32_t voice = 0;  // Pairs a generated note-off with its note-on
+	};
+
+	struct Run {
+		std::vector<RunEvent> events;
+		uint32_t voices = 0;
+		uint32_t openNotes = 0; // Note-ons without a generated off
+		std::vector<MidiEvent> source; // Checked on a fingerprint hit
+		uint64_t lastUsed = 0; // Build generation; unused runs are evicted
+	};
+
+	struct StaleRun {
+		Run* run = nullptr;
+		const MidiItem* item = nullptr;
+	};
+
+	static void expand(const MidiItem& item, Run& run);
+	void expandAll(const std::vector<StaleRun>& stale, size_t events) const;
+
+	std::unordered_map<uint64_t, Run> runs_;
+	uint64_t generation_ = 0;
+	size_t maxThreads_;
+	Stats stats_;
+};
+
+} // namespace linearseq
+
+namespace linearseq::PlaybackQueue {
+
+// Flattens every track (the track channel overriding the event's) into one stream
+// ordered by dispatch tick, with an explicit note-off for every note that has a duration.
+// Each track's events are moved by its offset plus its port's (Song::portOffsets),
+// rounded to whole ticks at the tempo in effect, but never across tick 0 or the loop
+// region's bounds, and by at most PlaybackQueueBuilder::MAX_SHIFT ticks.
+// Mute and solo are left to playback (see TrackMask), except on tracks past
+// TrackMask::MAX_TRACKS, which are dropped here when silent. Ordering rules:
+// - At the same tick note-offs come first, so a re-struck pitch is not cut by the
+//   previous note's off.
+// - When notes on the same channel and pitch overlap within a track, the newer note-on
+//   retriggers: an off is inserted right before it and the older note's own off is
+//   dropped. Overlaps between tracks keep both offs; playback retriggers among the
+//   tracks that are heard, so a silenced track never cuts another's note.
+// Otherwise events keep their song order (track, item, event).
+std::vector<PlaybackEvent> build(const Song& song);
+
+// The offset a track's events are moved by: its own plus that of the port it plays on.
+double outputOffsetMs(const Song& song, const Track& track);
+
+// Offsets are applied in whole ticks, so they are off by up to half a tick and shorter
+// ones may round to nothing. This is one tick at the song's slowest tempo: nonzero
+// offsets below it are rejected when set (see MainWindow::onTrackOutputOffset).
+double minOutputOffsetMs(const Song& song);
+
+// NoteOff, or NoteOn with velocity 0.
+bool isNoteOff(const PlaybackEvent& event);
+
+} // namespace linearseq::PlaybackQueue
@@ -1,33 +1,135 @@
 #include "core/Sequencer.h"
 #include "audio/AlsaDriver.h"
+#include "audio/MidiOutput.h"
 
 #include <algorithm>
 #include <chrono>
 
+namespace {
+
+constexpr uint32_t DEFAULT_LOOK_AHEAD_MS = 100;
+constexpr uint32_t MIN_LOOK_AHEAD_MS = 10;
+constexpr uint32_t MAX_LOOK_AHEAD_MS = 1000;
+constexpr uint32_t DEFAULT_LATE_THRESHOLD_MS = 20;
+// Upper bound on how long the input thread blocks before rechecking for shutdown.
+constexpr int INPUT_POLL_MS = 10;
+// Chase checkpoints every this many bars (songs carry no meter, so 4/4 is assumed).
+constexpr uint64_t CHASE_BARS = 4;
+
+int64_t steadyNowNs() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint64_t chaseInterval(const linearseq::Song& song) {
+	return CHASE_BARS * 4 * song.ppqn;
+}
+
+// Whether the songs share a tempo map: edits to notes alone keep the tick source's.
+bool sameTempo(const linearseq::Song& a, const linearseq::Song& b) {
+	return a.bpm == b.bpm && a.ppqn == b.ppqn &&
+		std::equal(a.tempoEvents.begin(), a.tempoEvents.end(), b.tempoEvents.begin(), b.tempoEvents.end(),
+			[](const linearseq::TempoEvent& x, const linearseq::TempoEvent& y) {
+				return x.tick == y.tick && x.bpm == y.bpm;
+			});
+}
+
+// Value a controller the song set earlier is put back to when the chased position
+// leaves it unset (General MIDI power-on values), or UNSET for data entry and
+// increment/decrement, which act on the selected parameter rather than hold state.
+uint8_t controllerDefault(uint8_t controller) {
+	switch (controller) {
+		case 6: case 38: case 96: case 97:
+			return linearseq::ChaseState::UNSET;
+		case 7:
+			return 100;
+		case 8: case 10:
+			return 64;
+		case 11:
+			return 127;
+		case 98: case 99: case 100: case 101:
+			return 127; // Null parameter number
+		default:
+			return 0;
+	}
+}
+
+} // namespace
+
 namespace linearseq {
 
 Sequencer::Sequencer()
-	: playing_(false), 
+	: source_(&clock_),
+	  driver_(nullptr),
+	  output_(nullptr),
+	  playing_(false),
 	  stopRequested_(false),
+	  paused_(false),
+	  pausedTick_(0),
+	  resumePolicy_(ResumePolicy::Retrigger),
+	  pendingSnapshot_(nullptr),
+	  retiredSnapshots_(nullptr),
 	  playbackIndex_(0),
+	  skipBefore_(0),
+	  skipEnd_(0),
+	  soundingVoices_(0),
+	  destination_(0),
+	  appliedMaskVersion_(0),
+	  loopStart_(0),
+	  loopEnd_(0),
+	  loopOffset_(0),
+	  scheduledTick_(0),
+	  clockMode_(Clock::Mode::EveryTick),
+	  outputMode_(OutputMode::Direct),
+	  lookAheadMs_(DEFAULT_LOOK_AHEAD_MS),
+	  activeOutputMode_(OutputMode::Direct),
+	  latePolicy_(LatePolicy::Burst),
+	  lateThresholdMs_(DEFAULT_LATE_THRESHOLD_MS),
+	  dropLateNotes_(false),
+	  lateThresholdNs_(0),
+	  queueStartTick_(0),
+	  nextRefillTick_(0),
+	  sendClock_(false),
+	  clockOutActive_(false),
+	  clockPpqn_(DEFAULT_PPQN),
+	  nextClockPulse_(0),
+	  nextClockTick_(TickSource::NO_TICK),
+	  inputRunning_(false),
 	  recording_(false), 
-	  activeTrack_(0), 
-	  driver_(nullptr), 
-	  recordingTrack_(-1), 
-	  recordingItem_(-1) {
-	clock_.setTickCallback([this](uint64_t tick) { onTick(tick); });
-}
+	  activeTrack_(0),
+	  recordingTrack_(-1),
+	  recordingItem_(-1) {}
 
 Sequencer::~Sequencer() {
+	clock_.setSyncSource(Clock::SyncSource::Internal);
 	stopRecording();
+	stopInputIfIdle();
 	stop();
+	delete pendingSnapshot_.exchange(nullptr);
+	reclaimSnapshots();
 }
 
 void Sequencer::setSong(const Song& song) {
-	std::lock_guard<std::mutex> lock(mutex_);
-	song_ = song;
-	clock_.setBpm(song_.bpm);
-	clock_.setPpqn(song_.ppqn);
+	// Built before taking the lock so recording input is not held up.
+	std::unique_ptr<PlaybackSnapshot> snapshot;
+	if (isPlaying() || isPaused()) {
+		std::lock_guard<std::mutex> lock(builderMutex_);
+		snapshot = std::make_unique<PlaybackSnapshot>(queueBuilder_.build(song), chaseInterval(song));
+		snapshot->setTrackDestinations(trackDestinations(song, false));
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		const bool tempoChanged = !sameTempo(song_, song);
+		song_ = song;
+		trackMask_.update(song_);
+		if (tempoChanged) {
+			source_->setTempoMap(playbackTempoMap());
+		}
+	}
+	if (snapshot) {
+		publishSnapshot(std::move(snapshot));
+		source_->wake();
+	}
 }
 
 Song Sequencer::song() const {
@@ -35,50 +137,336 @@ Song Sequencer::song() const {
 	return song_;
 }
 
+void Sequencer::setTrackMute(int index, bool mute) {
+	updateTrackState(index, &Track::mute, mute);
+}
+
+void Sequencer::setTrackSolo(int index, bool solo) {
+	updateTrackState(index, &Track::solo, solo);
+}
+
+void Sequencer::updateTrackState(int index, bool Track::*flag, bool value) {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (index < 0 || index >= static_cast<int>(song_.tracks.size())) {
+			return;
+		}
+		song_.tracks[index].*flag = value;
+		trackMask_.update(song_);
+	}
+	if (isPlaying()) {
+		source_->wake();
+	}
+}
+
 void Sequencer::play(uint64_t startTick) {
+	std::lock_guard<std::recursive_mutex> transport(transportMutex_);
 	if (playing_.exchange(true)) {
 		return;
 	}
-	{
-		std::lock_guard<std::mutex> lock(pendingMutex_);
-		pendingOffs_.clear();
-	}
+	paused_.store(false);
+	// The clock is stopped: anything published before now is superseded by this build.
+	delete pendingSnapshot_.exchange(nullptr);
+	reclaimSnapshots();
 	buildPlaybackQueue();
+	startLoop(startTick);
+	clock_.resetStats();
+	dispatchStats_.reset();
 	
-	// Skip ahead to startTick in the playback queue
-	playbackIndex_ = 0;
-	for (size_t i = 0; i < playbackQueue_.size(); ++i) {
-		if (playbackQueue_[i].absTick >= startTick) {
-			playbackIndex_ = i;
-			break;
-		}
+	// Skip ahead to startTick in the playback queue, restoring the channel state the
+	// skipped part would have set up. Events an output offset moved ahead of startTick
+	// play right at the start; those it moved past startTick from before are skipped.
+	playbackIndex_ = snapshot_->indexAt(startTick - std::min<uint64_t>(startTick, snapshot_->lead()));
+	skipBefore_ = startTick;
+	skipEnd_ = snapshot_->indexAt(startTick + snapshot_->lag() + 1);
+	soundingTrack_.fill(NO_TRACK);
+	soundingVoices_ = 0;
+	appliedMaskVersion_ = trackMask_.version();
+	scheduledTick_ = startTick;
+	destination_ = 0;
+	if (output_) {
+		output_->setDestination(0);
+	}
+	if (startTick > 0 || !stoppedState_.empty()) {
+		chaseAllDestinations(snapshot_->chaseStateAt(startTick), stoppedState_, false, TickSource::NO_TICK);
+	}
+	stoppedState_ = ChaseState();
+
+	activeOutputMode_ = outputMode_.load();
+	if (clock_.syncSource() == Clock::SyncSource::MidiClock) {
+		// The ALSA queue would run on its own tempo rather than the master's.
+		activeOutputMode_ = OutputMode::Direct;
+	}
+	if (activeOutputMode_ == OutputMode::Queued && !startQueuedPlayback(startTick)) {
+		// No ALSA queue available: fall back to direct output.
+		activeOutputMode_ = OutputMode::Direct;
+	}
+	// Queued output only needs the clock at refill points.
+	clock_.setMode(activeOutputMode_ == OutputMode::Queued ? Clock::Mode::NextEvent : clockMode_);
+	const LatePolicy latePolicy = latePolicy_.load();
+	dropLateNotes_ = latePolicy == LatePolicy::DropNotes;
+	lateThresholdNs_ = static_cast<int64_t>(lateThresholdMs_.load()) * 1000000;
+	clock_.setCatchUp(latePolicy == LatePolicy::Compress ? Clock::CatchUp::Compress : Clock::CatchUp::Burst,
+		lateThresholdNs_);
+	startClockOutput(startTick);
+	if (output_ && activeOutputMode_ == OutputMode::Direct) {
+		output_->setBatching(true);
 	}
 	
-	clock_.start(startTick);
+	source_->setTickSink(selectTickSink());
+	source_->start(startTick);
 }
 
 void Sequencer::stop() {
+	std::lock_guard<std::recursive_mutex> transport(transportMutex_);
+	if (paused_.exchange(false)) {
+		// pause() already stopped the clock and silenced the output.
+		stoppedState_ = snapshot_->chaseStateAt(songPosition(pausedTick_.load()) + 1);
+		std::lock_guard<std::mutex> lock(mutex_);
+		source_->setTempoMap(playbackTempoMap());
+		clockOutActive_ = false;
+		nextClockTick_ = TickSource::NO_TICK;
+		return;
+	}
 	if (!playing_.exchange(false)) {
 		return;
 	}
 	stopRequested_.store(false); // Clear the flag
+	// Stop ticking first: the tick paths do not check playing_.
+	source_->stop();
+	stoppedState_ = snapshot_->chaseStateAt(songPosition(source_->currentTick()) + 1);
+	if (output_) {
+		output_->setBatching(false);
+	}
+	reclaimSnapshots();
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		source_->setTempoMap(playbackTempoMap());
+	}
+	if (activeOutputMode_ == OutputMode::Queued) {
+		silenceQueuedNotes();
+	}
 	// Send All Notes Off to prevent stuck notes
 	allNotesOff();
-	clock_.stop();
+	if (clockOutActive_) {
+		if (output_) {
+			output_->sendRealtime(MidiStatus::Stop);
+		}
+		clockOutActive_ = false;
+		nextClockTick_ = TickSource::NO_TICK;
+	}
+}
+
+void Sequencer::pause() {
+	std::lock_guard<std::recursive_mutex> transport(transportMutex_);
+	if (isRecording() || !playing_.exchange(false)) {
+		return;
+	}
+	stopRequested_.store(false);
+	// In NextEvent mode the running clock reports the position between events.
+	const uint64_t position = source_->currentTick();
+	source_->stop();
+	if (output_) {
+		output_->setBatching(false);
+	}
+	uint64_t tick = std::max(position, source_->currentTick());
+
+	if (activeOutputMode_ == OutputMode::Queued) {
+		// Everything after the queue position was dropped with the queue: step the
+		// cursor back to it, undoing a wrap that was pre-rolled onto the queue.
+		tick = silenceQueuedNotes();
+		soundingTrack_.fill(NO_TRACK);
+		soundingVoices_ = 0;
+		const uint64_t loopStart = loopStart_.load(std::memory_order_relaxed);
+		const uint64_t loopLength = loopEnd_.load(std::memory_order_relaxed) - loopStart;
+		while (loopOffset_ > 0 && tick < loopStart + loopOffset_) {
+			loopOffset_ -= loopLength;
+		}
+		playbackIndex_ = snapshot_->indexAt(tick - loopOffset_ + 1);
+		if (clockOutActive_) {
+			nextClockPulse_ = tick * MidiClockSync::PULSES_PER_QUARTER / clockPpqn_ + 1;
+			nextClockTick_ = clockPulseTick(nextClockPulse_);
+		}
+	} else {
+		// Resuming at tick dispatches it again; events already sent there are behind
+		// playbackIndex_ and are not repeated.
+		for (size_t slot = 0; slot < VOICE_SLOTS; ++slot) {
+			if (soundingTrack_[slot] != NO_TRACK) {
+				releaseVoice(slot, tick);
+				freeVoice(slot);
+			}
+		}
+	}
+	if (clockOutActive_) {
+		output_->sendRealtime(MidiStatus::Stop);
+	}
+	pausedTick_.store(tick);
+	paused_.store(true);
+}
+
+void Sequencer::resume() {
+	std::lock_guard<std::recursive_mutex> transport(transportMutex_);
+	if (!paused_.load() || playing_.exchange(true)) {
+		return;
+	}
+	paused_.store(false);
+	const uint64_t tick = pausedTick_.load();
+	// Edits made while paused take over here; nothing is sounding to release. Ports
+	// they route to are added now, while the tick source is still stopped.
+	adoptPendingSnapshot(tick);
+	reclaimSnapshots();
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		snapshot_->setTrackDestinations(trackDestinations(song_, true));
+	}
+	appliedMaskVersion_ = trackMask_.version();
+	scheduledTick_ = tick;
+	if (resumePolicy_.load() == ResumePolicy::Retrigger) {
+		retriggerHeldNotes();
+	}
+
+	if (activeOutputMode_ == OutputMode::Queued && !startQueuedPlayback(tick)) {
+		activeOutputMode_ = OutputMode::Direct;
+		clock_.setMode(clockMode_);
+	}
+	if (clockOutActive_) {
+		output_->sendRealtime(MidiStatus::Continue);
+	}
+	if (output_ && activeOutputMode_ == OutputMode::Direct) {
+		output_->setBatching(true);
+	}
+
+	source_->setTickSink(selectTickSink());
+	source_->start(tick);
+}
+
+bool Sequencer::isPaused() const {
+	return paused_.load();
+}
+
+void Sequencer::setResumePolicy(ResumePolicy policy) {
+	resumePolicy_.store(policy);
+}
+
+Sequencer::ResumePolicy Sequencer::resumePolicy() const {
+	return resumePolicy_.load();
+}
+
+void Sequencer::retriggerHeldNotes() {
+	if (!output_ || !output_->isOpen()) {
+		return;
+	}
+	for (size_t slot = 0; slot < VOICE_SLOTS; ++slot) {
+		const PlaybackEvent* note = snapshot_->noteSoundingAt(slot, playbackIndex_, trackMask_);
+		if (note) {
+			routeTo(note->track);
+			output_->sendNoteOn(note->channel, note->data1, note->data2);
+			holdVoice(slot, note->track);
+		}
+	}
+}
+
+void Sequencer::seek(uint64_t tick) {
+	std::lock_guard<std::recursive_mutex> transport(transportMutex_);
+	if (!isPlaying() || isRecording()) {
+		return;
+	}
+	stop();
+	play(tick);
 }
 
 bool Sequencer::shouldStop() const {
 	return stopRequested_.load();
 }
 
+void Sequencer::chaseAllDestinations(const ChaseState& state, const ChaseState& previous, bool changesOnly,
+		uint64_t tick) {
+	// Chase state is per channel rather than per track: every destination gets it.
+	const std::vector<uint16_t>& destinations = snapshot_->trackDestinations();
+	auto chase = [&](uint16_t destination) {
+		if (output_) {
+			output_->setDestination(destination);
+			destination_ = destination;
+		}
+		sendChaseState(state, previous, changesOnly, tick);
+	};
+	if (destinations.empty()) {
+		chase(0);
+		return;
+	}
+	for (auto it = destinations.begin(); it != destinations.end(); ++it) {
+		if (std::find(destinations.begin(), it, *it) == it) {
+			chase(*it);
+		}
+	}
+}
+
+void Sequencer::sendChaseState(const ChaseState& state, const ChaseState& previous, bool changesOnly,
+		uint64_t tick) {
+	if (!output_ || !output_->isOpen()) {
+		return;
+	}
+	// Bank select goes ahead of the program change, other controllers after it.
+	// Controllers and bend set in previous but not in state go back to their defaults;
+	// a program has no neutral value and is left as it is.
+	constexpr uint8_t BANK_SELECT_MSB = 0;
+	constexpr uint8_t BANK_SELECT_LSB = 32;
+	constexpr uint16_t BEND_CENTER = 0x2000;
+	const bool queued = tick != TickSource::NO_TICK && activeOutputMode_ == OutputMode::Queued;
+	auto send = [&](MidiStatus status, uint8_t channel, uint8_t data1, uint8_t data2) {
+		if (queued) {
+			MidiEvent event;
+			event.tick = static_cast<uint32_t>(tick - queueStartTick_);
+			event.status = status;
+			event.channel = channel;
+			event.data1 = data1;
+			event.data2 = data2;
+			output_->scheduleEvent(event);
+		} else if (status == MidiStatus::ControlChange) {
+			output_->sendControlChange(channel, data1, data2);
+		} else if (status == MidiStatus::ProgramChange) {
+			output_->sendProgramChange(channel, data1);
+		} else {
+			output_->sendPitchBend(channel, data1, data2);
+		}
+	};
+	auto sendController = [&](uint8_t channel, uint8_t controller) {
+		const uint8_t before = previous.controllers[channel][controller];
+		uint8_t value = state.controllers[channel][controller];
+		if (value == ChaseState::UNSET && before != ChaseState::UNSET) {
+			value = controllerDefault(controller);
+		}
+		if (value != ChaseState::UNSET && !(changesOnly && value == before)) {
+			send(MidiStatus::ControlChange, channel, controller, value);
+		}
+	};
+	for (uint8_t channel = 0; channel < 16; ++channel) {
+		sendController(channel, BANK_SELECT_MSB);
+		sendController(channel, BANK_SELECT_LSB);
+		const uint8_t program = state.programs[channel];
+		if (program != ChaseState::UNSET && !(changesOnly && program == previous.programs[channel])) {
+			send(MidiStatus::ProgramChange, channel, program, 0);
+		}
+		for (uint8_t controller = 0; controller < 128; ++controller) {
+			if (controller != BANK_SELECT_MSB && controller != BANK_SELECT_LSB) {
+				sendController(channel, controller);
+			}
+		}
+		uint16_t bend = state.bends[channel];
+		if (bend == ChaseState::BEND_UNSET && previous.bends[channel] != ChaseState::BEND_UNSET) {
+			bend = BEND_CENTER;
+		}
+		if (bend != ChaseState::BEND_UNSET && !(changesOnly && bend == previous.bends[channel])) {
+			send(MidiStatus::PitchBend, channel, static_cast<uint8_t>(bend & 0x7F), static_cast<uint8_t>(bend >> 7));
+		}
+	}
+}
+
 void Sequencer::allNotesOff() {
-	if (!driver_ || !driver_->isOpen()) {
+	if (!output_ || !output_->isOpen()) {
 		return;
 	}
-	driver_->sendAllNotesOff();
-	// Also clear any pending note offs
-	std::lock_guard<std::mutex> lock(pendingMutex_);
-	pendingOffs_.clear();
+	output_->sendAllNotesOff();
 }
 
 bool Sequencer::isPlaying() const {
@@ -87,45 +475,220 @@ bool Sequencer::isPlaying() const {
 
 void Sequencer::buildPlaybackQueue() {
 	std::lock_guard<std::mutex> lock(mutex_);
-	playbackQueue_.clear();
+	std::lock_guard<std::mutex> builderLock(builderMutex_);
+	snapshot_ = std::make_unique<PlaybackSnapshot>(queueBuilder_.build(song_), chaseInterval(song_));
+	snapshot_->setTrackDestinations(trackDestinations(song_, true));
 	playbackIndex_ = 0;
+}
 
-	// Check if any tracks are soloed
-	bool anySolo = false;
-	for (const auto& track : song_.tracks) {
-		if (track.solo) {
-			anySolo = true;
-			break;
+void Sequencer::startLoop(uint64_t startTick) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	const bool loop = song_.loopEnabled && song_.loopEnd > song_.loopStart && startTick < song_.loopEnd;
+	loopStart_.store(loop ? song_.loopStart : 0, std::memory_order_relaxed);
+	loopEnd_.store(loop ? song_.loopEnd : 0, std::memory_order_relaxed);
+	loopOffset_ = 0;
+	source_->setTempoMap(playbackTempoMap());
+}
+
+std::shared_ptr<const TempoMap> Sequencer::playbackTempoMap() const {
+	const TempoMap map = TempoMap::fromSong(song_);
+	const uint64_t loopEnd = loopEnd_.load(std::memory_order_relaxed);
+	if ((!isPlaying() && !isPaused()) || loopEnd == 0) {
+		return std::make_shared<TempoMap>(map);
+	}
+	return std::make_shared<TempoMap>(map.looped(loopStart_.load(std::memory_order_relaxed), loopEnd));
+}
+
+uint64_t Sequencer::loopPassEnd() const {
+	const uint64_t loopEnd = loopEnd_.load(std::memory_order_relaxed);
+	return loopEnd != 0 ? loopEnd : TickSource::NO_TICK;
+}
+
+uint64_t Sequencer::songPosition(uint64_t tick) const {
+	const uint64_t loopEnd = loopEnd_.load(std::memory_order_relaxed);
+	if (loopEnd == 0 || tick < loopEnd) {
+		return tick;
+	}
+	const uint64_t loopStart = loopStart_.load(std::memory_order_relaxed);
+	return loopStart + (tick - loopStart) % (loopEnd - loopStart);
+}
+
+void Sequencer::wrapLoop() {
+	const uint64_t loopStart = loopStart_.load(std::memory_order_relaxed);
+	const uint64_t loopEnd = loopEnd_.load(std::memory_order_relaxed);
+	// Notes still sounding at the loop end are cut there, before the next pass begins.
+	const uint64_t wrapTick = loopEnd + loopOffset_;
+	for (size_t slot = 0; slot < VOICE_SLOTS; ++slot) {
+		if (soundingTrack_[slot] != NO_TRACK) {
+			releaseVoice(slot, wrapTick);
+			freeVoice(slot);
 		}
 	}
+	// The next pass starts from the channel state at the loop start, not the loop end.
+	const ChaseState state = snapshot_->chaseStateAt(loopStart);
+	const ChaseState previous = snapshot_->chaseStateAt(loopEnd);
+	chaseAllDestinations(state, previous, true, wrapTick);
+	loopOffset_ += loopEnd - loopStart;
+	playbackIndex_ = snapshot_->indexAt(loopStart);
+	skipEnd_ = 0; // Offsets never cross the loop bounds (see PlaybackQueue::build)
+}
+
+std::vector<uint16_t> Sequencer::trackDestinations(const Song& song, bool addMissing) {
+	std::vector<uint16_t> destinations(song.tracks.size(), 0);
+	if (!output_ || !output_->isOpen()) {
+		return destinations;
+	}
+	for (size_t t = 0; t < song.tracks.size(); ++t) {
+		const Track& track = song.tracks[t];
+		destinations[t] = addMissing ? output_->addDestination(track.alsaClient, track.alsaPort)
+			: output_->findDestination(track.alsaClient, track.alsaPort);
+	}
+	return destinations;
+}
+
+void Sequencer::routeTo(uint16_t track) {
+	routeToDestination(snapshot_->destinationOf(track));
+}
+
+void Sequencer::routeToDestination(uint16_t destination) {
+	if (destination != destination_) {
+		output_->setDestination(destination);
+		destination_ = destination;
+	}
+}
+
+void Sequencer::holdVoice(size_t slot, uint16_t track) {
+	if (soundingTrack_[slot] == NO_TRACK) {
+		++soundingVoices_;
+	}
+	soundingTrack_[slot] = track;
+	soundingDestination_[slot] = destination_;
+}
+
+void Sequencer::freeVoice(size_t slot) {
+	if (soundingTrack_[slot] != NO_TRACK) {
+		soundingTrack_[slot] = NO_TRACK;
+		--soundingVoices_;
+	}
+}
+
+void Sequencer::recordDispatch(const PlaybackEvent& event, uint64_t tick) {
+	// Measured against the deadline of the event's own tick, which is earlier than
+	// tick's for events held over (a burst, or moved ahead of the start).
+	const uint64_t due = event.absTick + loopOffset_;
+	const int64_t lateNs = due < tick ? source_->tickLatenessNs(due) : source_->tickLatenessNs();
+	const DispatchStats::Kind kind = PlaybackQueue::isNoteOff(event)
+		? DispatchStats::NoteOff
+		: DispatchStats::kindOf(event.status);
+	dispatchStats_.record(kind, event.track, static_cast<uint64_t>(std::max<int64_t>(lateNs, 0)));
+}
 
-	for (const auto& track : song_.tracks) {
-		// Skip muted tracks
-		if (track.mute) {
+size_t Sequencer::eventsAhead(uint64_t tick) const {
+	// Stream events from tick up to what is scheduled; past a wrap, the rest of the old
+	// pass plus the start of the new one.
+	const uint64_t loopStart = loopStart_.load(std::memory_order_relaxed);
+	const uint64_t loopEnd = loopEnd_.load(std::memory_order_relaxed);
+	if (loopEnd == 0 || loopOffset_ == 0 || tick >= loopStart + loopOffset_) {
+		const size_t from = snapshot_->indexAt(tick - std::min(tick, loopOffset_) + 1);
+		return playbackIndex_ > from ? playbackIndex_ - from : 0;
+	}
+	const uint64_t previousOffset = loopOffset_ - (loopEnd - loopStart);
+	const size_t from = snapshot_->indexAt(tick - std::min(tick, previousOffset) + 1);
+	const size_t passEnd = snapshot_->indexAt(loopEnd);
+	return (passEnd > from ? passEnd - from : 0) + (playbackIndex_ - snapshot_->indexAt(loopStart));
+}
+
+void Sequencer::publishSnapshot(std::unique_ptr<PlaybackSnapshot> snapshot) {
+	reclaimSnapshots();
+	// A snapshot still pending was never seen by the tick thread (it takes them with
+	// an exchange), so it can be freed here.
+	delete pendingSnapshot_.exchange(snapshot.release(), std::memory_order_acq_rel);
+}
+
+void Sequencer::adoptPendingSnapshot(uint64_t tick) {
+	PlaybackSnapshot* next = pendingSnapshot_.exchange(nullptr, std::memory_order_acquire);
+	if (!next) {
+		return;
+	}
+	// Notes the new stream releases keep sounding; the rest would hang, so end them now.
+	const uint64_t songTick = tick - loopOffset_;
+	// A kept note passes to the track whose off releases it.
+	for (size_t slot = 0; slot < VOICE_SLOTS; ++slot) {
+		if (soundingTrack_[slot] == NO_TRACK) {
 			continue;
 		}
-		
-		// Skip track if solo mode is active and this track is not soloed
-		if (anySolo && !track.solo) {
-			continue;
+		if (const PlaybackEvent* off = next->releaseOf(slot, songTick)) {
+			soundingTrack_[slot] = off->track;
+		} else {
+			releaseVoice(slot, tick);
+			freeVoice(slot);
 		}
-		
-		for (const auto& item : track.items) {
-			for (const auto& event : item.events) {
-				PlaybackEvent pe;
-				pe.absTick = static_cast<uint64_t>(item.startTick) + event.tick;
-				pe.duration = event.duration;
-				pe.status = event.status;
-				// Override event channel with track channel for playback
-				pe.channel = track.channel; 
-				pe.data1 = event.data1;
-				pe.data2 = event.data2;
-				playbackQueue_.push_back(pe);
-			}
+	}
+	playbackIndex_ = next->indexAt(songTick);
+	if (skipEnd_ > 0) {
+		skipEnd_ = next->indexAt(skipBefore_ + next->lag() + 1);
+	}
+
+	PlaybackSnapshot* old = snapshot_.release();
+	snapshot_.reset(next);
+	if (old) {
+		old->retiredNext = retiredSnapshots_.load(std::memory_order_relaxed);
+		while (!retiredSnapshots_.compare_exchange_weak(old->retiredNext, old,
+			std::memory_order_release, std::memory_order_relaxed)) {
+		}
+	}
+}
+
+void Sequencer::releaseVoice(size_t slot, uint64_t tick) {
+	const uint8_t channel = static_cast<uint8_t>(slot / 128);
+	const uint8_t pitch = static_cast<uint8_t>(slot % 128);
+	routeToDestination(soundingDestination_[slot]);
+	if (activeOutputMode_ == OutputMode::Queued) {
+		MidiEvent off;
+		off.tick = static_cast<uint32_t>(tick - queueStartTick_);
+		off.status = MidiStatus::NoteOff;
+		off.channel = channel;
+		off.data1 = pitch;
+		output_->scheduleEvent(off);
+	} else {
+		output_->sendNoteOff(channel, pitch, 0);
+	}
+}
+
+void Sequencer::takeVoice(const PlaybackEvent& event) {
+	const size_t slot = voiceSlot(event.channel, event.data1);
+	if (soundingTrack_[slot] != NO_TRACK) {
+		// Another track's note on this pitch: retrigger, as the stream does within a track.
+		routeToDestination(soundingDestination_[slot]);
+		output_->sendNoteOff(event.channel, event.data1, 0);
+		routeTo(event.track);
+	}
+	output_->sendNoteOn(event.channel, event.data1, event.data2);
+	holdVoice(slot, event.track);
+}
+
+void Sequencer::applyTrackMask(uint64_t tick) {
+	appliedMaskVersion_ = trackMask_.version();
+	for (size_t slot = 0; slot < VOICE_SLOTS; ++slot) {
+		if (soundingTrack_[slot] != NO_TRACK && !trackMask_.enabled(soundingTrack_[slot])) {
+			releaseVoice(slot, tick);
+			freeVoice(slot);
 		}
 	}
+}
+
+bool Sequencer::hasPendingChange() const {
+	return pendingSnapshot_.load(std::memory_order_relaxed) != nullptr ||
+		trackMask_.version() != appliedMaskVersion_;
+}
 
-	std::sort(playbackQueue_.begin(), playbackQueue_.end());
+void Sequencer::reclaimSnapshots() {
+	PlaybackSnapshot* retired = retiredSnapshots_.exchange(nullptr, std::memory_order_acquire);
+	while (retired) {
+		PlaybackSnapshot* next = retired->retiredNext;
+		delete retired;
+		retired = next;
+	}
 }
 
 void Sequencer::startRecording() {
@@ -136,11 +699,13 @@ void Sequencer::startRecording() {
 		recording_.store(false);
 		return;
 	}
-	if (!isPlaying()) {
+	if (isPaused()) {
+		resume();
+	} else if (!isPlaying()) {
 		play();
 	}
 
-	const uint64_t startTick = clock_.currentTick();
+	const uint64_t startTick = songPosition(source_->currentTick());
 	{
 		std::lock_guard<std::mutex> lock(mutex_);
 		if (song_.tracks.empty()) {
@@ -165,16 +730,14 @@ void Sequencer::startRecording() {
 		activeNotes_.clear();
 	}
 
-	recordThread_ = std::thread(&Sequencer::recordLoop, this);
+	startInput();
 }
 
 void Sequencer::stopRecording() {
 	if (!recording_.exchange(false)) {
 		return;
 	}
-	if (recordThread_.joinable()) {
-		recordThread_.join();
-	}
+	stopInputIfIdle();
 
 	std::lock_guard<std::mutex> lock(mutex_);
 	if (recordingTrack_ >= 0 && recordingTrack_ < static_cast<int>(song_.tracks.size())) {
@@ -204,144 +767,609 @@ int Sequencer::activeTrack() const {
 }
 
 uint64_t Sequencer::currentTick() const {
-    return clock_.currentTick();
+    if (isPaused()) {
+        return songPosition(pausedTick_.load());
+    }
+    return songPosition(source_->currentTick());
 }
 
 void Sequencer::setDriver(AlsaDriver* driver) {
 	driver_ = driver;
+	output_ = driver;
 }
 
-void Sequencer::recordLoop() {
-	while (recording_.load()) {
-		MidiEvent inputEvent;
-		if (driver_ && driver_->readInputEvent(inputEvent)) {
-			const uint64_t nowTick = clock_.currentTick();
-			std::lock_guard<std::mutex> lock(mutex_);
-			if (recordingTrack_ < 0 || recordingTrack_ >= static_cast<int>(song_.tracks.size())) {
-				continue;
-			}
-			auto& track = song_.tracks[recordingTrack_];
-			if (recordingItem_ < 0 || recordingItem_ >= static_cast<int>(track.items.size())) {
-				continue;
-			}
-			auto& item = track.items[recordingItem_];
-			const uint64_t itemStart = item.startTick;
-			const uint64_t relTick = nowTick > itemStart ? (nowTick - itemStart) : 0;
-
-			if (inputEvent.status == MidiStatus::NoteOn && inputEvent.data2 > 0) {
-				MidiEvent ev = inputEvent;
-				ev.tick = static_cast<uint32_t>(relTick);
-				ev.duration = 0;
-				item.events.push_back(ev);
-				activeNotes_[{ev.channel, ev.data1}] = {item.events.size() - 1, nowTick};
-			} else if (inputEvent.status == MidiStatus::NoteOff ||
-				(inputEvent.status == MidiStatus::NoteOn && inputEvent.data2 == 0)) {
-				const auto key = std::make_pair(inputEvent.channel, inputEvent.data1);
-				auto it = activeNotes_.find(key);
-				if (it != activeNotes_.end()) {
-					const size_t index = it->second.first;
-					const uint64_t startTick = it->second.second;
-					if (index < item.events.size()) {
-						const uint64_t duration = nowTick > startTick ? (nowTick - startTick) : 0;
-						item.events[index].duration = static_cast<uint32_t>(duration);
-					}
-					activeNotes_.erase(it);
-				}
-			} else {
-				MidiEvent ev = inputEvent;
-				ev.tick = static_cast<uint32_t>(relTick);
-				ev.duration = 0;
-				item.events.push_back(ev);
-			}
+void Sequencer::setOutput(MidiOutput* output) {
+	output_ = output;
+}
 
-			item.lengthTicks = std::max(item.lengthTicks, static_cast<uint32_t>(relTick));
-		} else {
+void Sequencer::setTickSource(TickSource* source) {
+	if (isPlaying() || isPaused()) {
+		return;
+	}
+	TickSource* next = source ? source : &clock_;
+	if (next == source_) {
+		return;
+	}
+	next->setTempoMap(source_->tempoMap());
+	source_->setTickSink(TickSink());
+	source_ = next;
+}
+
+TickSource* Sequencer::tickSource() const {
+	return source_;
+}
+
+void Sequencer::setClockMode(Clock::Mode mode) {
+	clockMode_ = mode;
+	if (!isPlaying() || activeOutputMode_ == OutputMode::Direct) {
+		clock_.setMode(mode);
+	}
+}
+
+Clock::Mode Sequencer::clockMode() const {
+	return clockMode_;
+}
+
+void Sequencer::setOutputMode(OutputMode mode) {
+	outputMode_.store(mode);
+}
+
+Sequencer::OutputMode Sequencer::outputMode() const {
+	return outputMode_.load();
+}
+
+void Sequencer::setLookAheadMs(uint32_t ms) {
+	lookAheadMs_.store(std::clamp(ms, MIN_LOOK_AHEAD_MS, MAX_LOOK_AHEAD_MS));
+}
+
+uint32_t Sequencer::lookAheadMs() const {
+	return lookAheadMs_.load();
+}
+
+void Sequencer::setLatePolicy(LatePolicy policy) {
+	latePolicy_.store(policy);
+}
+
+Sequencer::LatePolicy Sequencer::latePolicy() const {
+	return latePolicy_.load();
+}
+
+void Sequencer::setLateThresholdMs(uint32_t ms) {
+	lateThresholdMs_.store(ms);
+}
+
+uint32_t Sequencer::lateThresholdMs() const {
+	return lateThresholdMs_.load();
+}
+
+void Sequencer::setSendMidiClock(bool enabled) {
+	sendClock_.store(enabled);
+}
+
+bool Sequencer::sendMidiClock() const {
+	return sendClock_.load();
+}
+
+void Sequencer::setSyncSource(Clock::SyncSource source) {
+	{
+		// Under the transport lock, so a sync message already being handled cannot
+		// start playback after the switch.
+		std::lock_guard<std::recursive_mutex> transport(transportMutex_);
+		if (source == clock_.syncSource()) {
+			return;
+		}
+		stop();
+		clock_.setSyncSource(source);
+		clock_.midiSync().reset();
+	}
+	if (source == Clock::SyncSource::MidiClock) {
+		startInput();
+	} else {
+		stopInputIfIdle();
+	}
+}
+
+Clock::SyncSource Sequencer::syncSource() const {
+	return clock_.syncSource();
+}
+
+MidiClockSync::Status Sequencer::syncStatus() const {
+	return clock_.midiSync().status();
+}
+
+std::shared_ptr<const TempoMap> Sequencer::tempoMap() const {
+	return source_->tempoMap();
+}
+
+const ClockStats& Sequencer::clockStats() const {
+	return clock_.stats();
+}
+
+void Sequencer::resetClockStats() {
+	clock_.resetStats();
+}
+
+bool Sequencer::dumpClockStats(const std::string& path) const {
+	return clock_.dumpStats(path);
+}
+
+const DispatchStats& Sequencer::dispatchStats() const {
+	return dispatchStats_;
+}
+
+void Sequencer::resetDispatchStats() {
+	dispatchStats_.reset();
+}
+
+bool Sequencer::dumpDispatchStats(const std::string& path) const {
+	return dispatchStats_.dumpToFile(path);
+}
+
+void Sequencer::startInput() {
+	std::lock_guard<std::mutex> lock(inputMutex_);
+	if (inputRunning_.exchange(true)) {
+		return;
+	}
+	inputThread_ = std::thread(&Sequencer::inputLoop, this);
+}
+
+void Sequencer::stopInputIfIdle() {
+	std::lock_guard<std::mutex> lock(inputMutex_);
+	if (recording_.load() || clock_.syncSource() == Clock::SyncSource::MidiClock) {
+		return;
+	}
+	if (!inputRunning_.exchange(false)) {
+		return;
+	}
+	if (inputThread_.joinable()) {
+		inputThread_.join();
+	}
+}
+
+void Sequencer::inputLoop() {
+	while (inputRunning_.load()) {
+		if (!driver_ || !driver_->isOpen()) {
 			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			continue;
+		}
+		MidiEvent inputEvent;
+		if (!driver_->readInputEvent(inputEvent)) {
+			// Block on the sequencer handle so clock pulses are timestamped as they arrive.
+			driver_->waitForInput(INPUT_POLL_MS);
+			continue;
+		}
+		if (static_cast<uint8_t>(inputEvent.status) >= 0xF0) {
+			if (clock_.syncSource() == Clock::SyncSource::MidiClock) {
+				handleSyncMessage(inputEvent, steadyNowNs());
+			}
+			continue;
 		}
+		recordEvent(inputEvent);
 	}
 }
 
-void Sequencer::onTick(uint64_t tick) {
-	if (!playing_.load()) {
+void Sequencer::handleSyncMessage(const MidiEvent& message, int64_t receivedNs) {
+	if (message.status == MidiStatus::TimingClock) {
+		clock_.receiveMidiClock(receivedNs);
 		return;
 	}
+	// Transport messages run on the input thread: serialize them with the UI's calls,
+	// and drop them if following was switched off meanwhile.
+	std::lock_guard<std::recursive_mutex> transport(transportMutex_);
+	if (clock_.syncSource() != Clock::SyncSource::MidiClock) {
+		return;
+	}
+	MidiClockSync& sync = clock_.midiSync();
+	const uint32_t ppqn = tempoMap()->ppqn();
+	switch (message.status) {
+		case MidiStatus::Start:
+			stop();
+			sync.locate(0);
+			sync.setTransportRunning(true);
+			play(0);
+			break;
+		case MidiStatus::Continue: {
+			stop();
+			const uint64_t pulse = sync.nextSongPulse();
+			sync.setTransportRunning(true);
+			play(pulse * ppqn / MidiClockSync::PULSES_PER_QUARTER);
+			break;
+		}
+		case MidiStatus::Stop:
+			sync.setTransportRunning(false);
+			stop();
+			break;
+		case MidiStatus::SongPosition: {
+			// Position is in 16th notes, 6 clock pulses each.
+			const uint64_t sixteenths = static_cast<uint64_t>(message.data1) |
+				(static_cast<uint64_t>(message.data2) << 7);
+			sync.locate(sixteenths * 6);
+			if (isPlaying()) {
+				seek(sixteenths * ppqn / 4);
+			}
+			break;
+		}
+		default:
+			break;
+	}
+}
 
-	if (!driver_ || !driver_->isOpen()) {
+void Sequencer::recordEvent(const MidiEvent& inputEvent) {
+	const uint64_t nowTick = songPosition(source_->currentTick());
+	std::lock_guard<std::mutex> lock(mutex_);
+	// Checked under the lock so nothing is added after stopRecording() finalizes the item.
+	if (!recording_.load()) {
+		return;
+	}
+	if (recordingTrack_ < 0 || recordingTrack_ >= static_cast<int>(song_.tracks.size())) {
+		return;
+	}
+	auto& track = song_.tracks[recordingTrack_];
+	if (recordingItem_ < 0 || recordingItem_ >= static_cast<int>(track.items.size())) {
 		return;
 	}
+	auto& item = track.items[recordingItem_];
+	const uint64_t itemStart = item.startTick;
+	const uint64_t relTick = nowTick > itemStart ? (nowTick - itemStart) : 0;
 
-	// 1. Process Pending Note Offs
-	{
-		std::lock_guard<std::mutex> lock(pendingMutex_);
-		auto it = pendingOffs_.begin();
-		while (it != pendingOffs_.end()) {
-			if (it->tick <= tick) {
-				driver_->sendNoteOff(it->channel, it->note, it->velocity);
-				it = pendingOffs_.erase(it);
-			} else {
-				++it;
+	if (inputEvent.status == MidiStatus::NoteOn && inputEvent.data2 > 0) {
+		MidiEvent ev = inputEvent;
+		ev.tick = static_cast<uint32_t>(relTick);
+		ev.duration = 0;
+		item.events.push_back(ev);
+		activeNotes_[{ev.channel, ev.data1}] = {item.events.size() - 1, nowTick};
+	} else if (inputEvent.status == MidiStatus::NoteOff ||
+		(inputEvent.status == MidiStatus::NoteOn && inputEvent.data2 == 0)) {
+		const auto key = std::make_pair(inputEvent.channel, inputEvent.data1);
+		auto it = activeNotes_.find(key);
+		if (it != activeNotes_.end()) {
+			const size_t index = it->second.first;
+			const uint64_t startTick = it->second.second;
+			if (index < item.events.size()) {
+				const uint64_t duration = nowTick > startTick ? (nowTick - startTick) : 0;
+				item.events[index].duration = static_cast<uint32_t>(duration);
 			}
+			activeNotes_.erase(it);
 		}
+	} else {
+		MidiEvent ev = inputEvent;
+		ev.tick = static_cast<uint32_t>(relTick);
+		ev.duration = 0;
+		item.events.push_back(ev);
 	}
 
-	// 2. Process Playback Queue
-	// We read without the song mutex because playbackQueue_ is invariant during playback.
-	while (playbackIndex_ < playbackQueue_.size()) {
-		const auto& event = playbackQueue_[playbackIndex_];
-		
-		if (event.absTick > tick) {
-			break; 
-		}
-		
-		// If we missed a tick (lag), catch up, but only fire if it's not too old? 
-		// For now, fire everything to maintain state.
-		if (event.absTick <= tick) {
-			switch (event.status) {
-				case MidiStatus::NoteOn:
-					driver_->sendNoteOn(event.channel, event.data1, event.data2);
-					if (event.duration > 0) {
-						PendingNoteOff pending;
-						pending.tick = event.absTick + event.duration;
-						pending.channel = event.channel;
-						pending.note = event.data1;
-						pending.velocity = 0;
-						std::lock_guard<std::mutex> lock(pendingMutex_);
-						pendingOffs_.push_back(pending);
-					}
-					break;
-				case MidiStatus::NoteOff:
-					driver_->sendNoteOff(event.channel, event.data1, event.data2);
-					break;
-				case MidiStatus::ControlChange:
-					driver_->sendControlChange(event.channel, event.data1, event.data2);
-					break;
-				case MidiStatus::ProgramChange:
-					driver_->sendProgramChange(event.channel, event.data1);
-					break;
-				case MidiStatus::PitchBend:
-					// TODO: Implement pitch bend in AlsaDriver
-					break;
-				default:
-					break;
+	item.lengthTicks = std::max(item.lengthTicks, static_cast<uint32_t>(relTick));
+}
+
+TickSink Sequencer::selectTickSink() {
+	if (!output_ || !output_->isOpen()) {
+		return TickSink();
+	}
+	if (activeOutputMode_ == OutputMode::Queued) {
+		return TickSink::bind<Sequencer, &Sequencer::scheduleAhead, &Sequencer::nextRefillTick>(this);
+	}
+	if (clockOutActive_) {
+		return TickSink::bind<Sequencer, &Sequencer::dispatchTick<true>, &Sequencer::nextDueTick>(this);
+	}
+	return TickSink::bind<Sequencer, &Sequencer::dispatchTick<false>, &Sequencer::nextDueTick>(this);
+}
+
+template <bool ClockOut>
+void Sequencer::dispatchTick(uint64_t tick) {
+	// 0. MIDI clock pulses go first so followers have advanced before the notes
+	if constexpr (ClockOut) {
+		while (nextClockTick_ <= tick) {
+			output_->sendRealtime(MidiStatus::TimingClock);
+			nextClockTick_ = clockPulseTick(++nextClockPulse_);
+		}
+	}
+
+	// Sends are batched (see MidiOutput::setBatching) and flushed once at the end.
+	bool sent = false;
+	uint64_t batch = 0; // Stream events handed to the output this tick
+	if (pendingSnapshot_.load(std::memory_order_relaxed) != nullptr) {
+		adoptPendingSnapshot(tick);
+		sent = true;
+	}
+	if (trackMask_.version() != appliedMaskVersion_) {
+		applyTrackMask(tick);
+		sent = true;
+	}
+
+	// 1. Process Playback Queue
+	// We read without the song mutex: edits arrive as a new snapshot, swapped in above.
+	// When looping, ticks run on past the loop end and loopOffset_ maps them back to
+	// song ticks of the current pass; the pass wraps in the same tick it ends.
+	const auto& queue = snapshot_->events();
+	const uint64_t passEnd = loopPassEnd();
+	// Whether this tick is late (see LatePolicy); asked once, when something falls due.
+	int late = -1;
+	for (;;) {
+		const uint64_t songTick = tick - loopOffset_;
+		while (playbackIndex_ < queue.size()) {
+			const auto& event = queue[playbackIndex_];
+			
+			if (event.absTick > songTick || event.absTick >= passEnd) {
+				break; 
+			}
+			if (playbackIndex_ < skipEnd_ && event.songTick() < skipBefore_) {
+				playbackIndex_++;
+				continue;
 			}
+			
+			if (late < 0) {
+				late = source_->tickLatenessNs() > lateThresholdNs_ ? 1 : 0;
+			}
+			if (late) {
+				clock_.stats().lateEvents.fetch_add(1, std::memory_order_relaxed);
+			}
+			sent = true;
+			bool handed = false;
+			if (PlaybackQueue::isNoteOff(event)) {
+				// An off releases only its own track's note: another track may have taken the
+				// voice since, and a silenced track's notes never take it.
+				const size_t slot = voiceSlot(event.channel, event.data1);
+				if (soundingTrack_[slot] == event.track) {
+					routeToDestination(soundingDestination_[slot]);
+					output_->sendNoteOff(event.channel, event.data1, event.data2);
+					freeVoice(slot);
+					handed = true;
+				}
+			} else if (trackMask_.enabled(event.track)) {
+				routeTo(event.track);
+				handed = true;
+				switch (event.status) {
+					case MidiStatus::NoteOn:
+						if (late && dropLateNotes_) {
+							// Never owned, so its off is skipped too.
+							clock_.stats().droppedNotes.fetch_add(1, std::memory_order_relaxed);
+							handed = false;
+							break;
+						}
+						takeVoice(event);
+						break;
+					case MidiStatus::ControlChange:
+						output_->sendControlChange(event.channel, event.data1, event.data2);
+						break;
+					case MidiStatus::ProgramChange:
+						output_->sendProgramChange(event.channel, event.data1);
+						break;
+					case MidiStatus::PitchBend:
+						output_->sendPitchBend(event.channel, event.data1, event.data2);
+						break;
+					default:
+						handed = false;
+						break;
+				}
+			}
+			if (handed) {
+				recordDispatch(event, tick);
+				++batch;
+			}
+			playbackIndex_++;
 		}
-		playbackIndex_++;
+		if (songTick < passEnd) {
+			break;
+		}
+		wrapLoop();
+	}
+	if (sent) {
+		output_->flushOutput();
+		dispatchStats_.sample(batch, soundingVoices_);
 	}
 	
-	// 3. Check if playback has finished
-	// Request stop if we've processed all events and there are no pending note-offs
+	// 2. Check if playback has finished
+	// Request stop once every event (including the last note-off) has been sent
 	// Don't call stop() directly to avoid deadlock - let MainWindow check this flag
-	if (playbackIndex_ >= playbackQueue_.size()) {
-		bool hasPendingOffs = false;
-		{
-			std::lock_guard<std::mutex> lock(pendingMutex_);
-			hasPendingOffs = !pendingOffs_.empty();
+	if (passEnd == TickSource::NO_TICK && playbackIndex_ >= queue.size()) {
+		stopRequested_.store(true);
+	}
+}
+
+uint64_t Sequencer::nextDueTick(uint64_t tick) {
+	// Runs on the clock thread right after dispatchTick(tick), so playbackIndex_ is stable.
+	uint64_t next = nextClockTick_;
+	const auto& queue = snapshot_->events();
+	const uint64_t passEnd = loopPassEnd();
+	if (playbackIndex_ < queue.size() && queue[playbackIndex_].absTick < passEnd) {
+		next = std::min<uint64_t>(next, queue[playbackIndex_].absTick + loopOffset_);
+	} else if (passEnd != TickSource::NO_TICK) {
+		next = std::min(next, passEnd + loopOffset_); // The wrap
+	}
+	// A published edit or mute/solo change applies at the current position.
+	if (hasPendingChange()) {
+		next = std::min(next, std::max(tick + 1, source_->currentTick()));
+	}
+	return next;
+}
+
+uint64_t Sequencer::nextRefillTick(uint64_t /*tick*/) {
+	return nextRefillTick_;
+}
+
+bool Sequencer::startQueuedPlayback(uint64_t startTick) {
+	if (!output_ || !output_->isOpen()) {
+		return false;
+	}
+	scheduleMap_ = source_->tempoMap();
+	const TempoMap& map = *scheduleMap_;
+	if (!output_->startQueue(map.ppqn(), map.bpmAt(startTick))) {
+		return false;
+	}
+
+	// Queue tick 0 is startTick; later tempo segments of its loop pass become scheduled
+	// tempo events, those of later passes are added as each pass is pre-rolled.
+	queueStartTick_ = startTick;
+	nextRefillTick_ = startTick;
+	const uint64_t passOffset = startTick - map.foldTick(startTick);
+	for (const auto& segment : map.segments()) {
+		if (segment.startTick + passOffset > startTick) {
+			output_->scheduleTempo(static_cast<uint32_t>(segment.startTick + passOffset - startTick), segment.bpm);
+		}
+	}
+	output_->flushOutput();
+	return true;
+}
+
+void Sequencer::scheduleAhead(uint64_t tick) {
+	if (tick < nextRefillTick_) {
+		return;
+	}
+	const TempoMap& map = *scheduleMap_;
+	const int64_t nowNs = map.tickToNs(tick);
+	const int64_t lookAheadNs = static_cast<int64_t>(lookAheadMs_.load()) * 1000000;
+	const uint64_t horizon = map.nsToTick(nowNs + lookAheadNs);
+
+	// Edits take over from the first tick not yet on the queue.
+	if (pendingSnapshot_.load(std::memory_order_relaxed) != nullptr) {
+		adoptPendingSnapshot(scheduledTick_);
+	}
+	if (trackMask_.version() != appliedMaskVersion_) {
+		applyTrackMask(scheduledTick_);
+	}
+
+	const auto& queue = snapshot_->events();
+	const uint64_t passEnd = loopPassEnd();
+	for (;;) {
+		scheduleUntil(std::min(horizon - loopOffset_, passEnd - 1));
+		if (horizon - loopOffset_ < passEnd) {
+			break;
+		}
+		// The next pass is pre-rolled onto the queue as soon as it is in the window.
+		wrapLoop();
+		if (map.loopEnd() != 0) {
+			scheduleLoopTempo(map);
 		}
-		
-		if (!hasPendingOffs) {
-			stopRequested_.store(true);
+	}
+	scheduledTick_ = std::max(scheduledTick_, horizon + 1);
+	dispatchStats_.sample(eventsAhead(tick), soundingVoices_);
+
+	// Everything is on the queue; stop once the last event has actually played.
+	if (passEnd == TickSource::NO_TICK && playbackIndex_ >= queue.size() &&
+		(queue.empty() || tick >= queue.back().absTick)) {
+		stopRequested_.store(true);
+	}
+
+	while (nextClockTick_ <= horizon) {
+		MidiEvent pulse;
+		pulse.tick = static_cast<uint32_t>(nextClockTick_ - queueStartTick_);
+		pulse.status = MidiStatus::TimingClock;
+		output_->scheduleEvent(pulse);
+		nextClockTick_ = clockPulseTick(++nextClockPulse_);
+	}
+	output_->flushOutput();
+
+	nextRefillTick_ = std::max(tick + 1, map.nsToTick(nowNs + lookAheadNs / 2));
+}
+
+void Sequencer::scheduleLoopTempo(const TempoMap& map) {
+	// The map holds one pass of the loop's tempo changes; the queue gets each pass's own.
+	const uint64_t passStart = map.loopStart() + loopOffset_;
+	output_->scheduleTempo(static_cast<uint32_t>(passStart - queueStartTick_), map.bpmAt(map.loopStart()));
+	for (const auto& segment : map.segments()) {
+		if (segment.startTick > map.loopStart()) {
+			output_->scheduleTempo(static_cast<uint32_t>(segment.startTick + loopOffset_ - queueStartTick_),
+				segment.bpm);
+		}
+	}
+}
+
+void Sequencer::scheduleUntil(uint64_t songTick) {
+	const auto& queue = snapshot_->events();
+	for (; playbackIndex_ < queue.size() && queue[playbackIndex_].absTick <= songTick; ++playbackIndex_) {
+		const auto& event = queue[playbackIndex_];
+		if (playbackIndex_ < skipEnd_ && event.songTick() < skipBefore_) {
+			continue;
+		}
+		// Same rules as direct output: offs release only their own track's note, and a
+		// note-on retriggers another track's note on the pitch.
+		const bool noteOff = PlaybackQueue::isNoteOff(event);
+		const bool note = event.status == MidiStatus::NoteOn || event.status == MidiStatus::NoteOff;
+		const size_t slot = note ? voiceSlot(event.channel, event.data1) : 0;
+		if (noteOff ? soundingTrack_[slot] != event.track : !trackMask_.enabled(event.track)) {
+			continue;
+		}
+		MidiEvent out;
+		// Events an output offset moved ahead of the start go out with the first.
+		const uint64_t due = std::max<uint64_t>(event.absTick + loopOffset_, queueStartTick_);
+		out.tick = static_cast<uint32_t>(due - queueStartTick_);
+		out.channel = event.channel;
+		out.data1 = event.data1;
+		if (note && !noteOff && soundingTrack_[slot] != NO_TRACK) {
+			routeToDestination(soundingDestination_[slot]);
+			out.status = MidiStatus::NoteOff;
+			output_->scheduleEvent(out);
+		}
+		if (noteOff) {
+			routeToDestination(soundingDestination_[slot]);
+		} else {
+			routeTo(event.track);
+		}
+		out.status = event.status;
+		out.data2 = event.data2;
+		output_->scheduleEvent(out);
+		if (noteOff) {
+			freeVoice(slot);
+		} else if (note) {
+			holdVoice(slot, event.track);
+		}
+	}
+}
+
+void Sequencer::startClockOutput(uint64_t startTick) {
+	clockOutActive_ = sendClock_.load() && output_ && output_->isOpen();
+	nextClockTick_ = TickSource::NO_TICK;
+	if (!clockOutActive_) {
+		return;
+	}
+	clockPpqn_ = tempoMap()->ppqn();
+	// Song Position Pointer counts 16th notes (6 pulses), so resume at the first
+	// 16th at or after startTick; no pulses are sent before it.
+	const uint64_t sixteenth = (startTick * 4 + clockPpqn_ - 1) / clockPpqn_;
+	nextClockPulse_ = sixteenth * 6;
+	nextClockTick_ = clockPulseTick(nextClockPulse_);
+	if (sixteenth == 0) {
+		output_->sendRealtime(MidiStatus::Start);
+	} else {
+		output_->sendSongPosition(static_cast<uint16_t>(std::min<uint64_t>(sixteenth, 0x3FFF)));
+		output_->sendRealtime(MidiStatus::Continue);
+	}
+}
+
+uint64_t Sequencer::clockPulseTick(uint64_t pulse) const {
+	// First tick at or after the pulse's exact position (ppqn need not divide by 24).
+	return (pulse * clockPpqn_ + MidiClockSync::PULSES_PER_QUARTER - 1) / MidiClockSync::PULSES_PER_QUARTER;
+}
+
+uint64_t Sequencer::silenceQueuedNotes() {
+	if (!output_ || !output_->isOpen()) {
+		return scheduledTick_;
+	}
+	const uint64_t position = queueStartTick_ + output_->queueTick();
+	output_->stopQueue();
+
+	// Note-offs scheduled but not yet delivered were dropped with the queue; their
+	// notes may still be sounding.
+	// If the window crossed a loop wrap this also covers the start of the pass; extra
+	// offs are harmless.
+	const uint64_t songPosition = position - std::min(position, loopOffset_);
+	const auto& queue = snapshot_->events();
+	auto it = std::upper_bound(queue.begin(), queue.begin() + playbackIndex_, songPosition,
+		[](uint64_t value, const PlaybackEvent& event) { return value < event.absTick; });
+	for (; it != queue.begin() + playbackIndex_; ++it) {
+		if (PlaybackQueue::isNoteOff(*it)) {
+			routeTo(it->track);
+			output_->sendNoteOff(it->channel, it->data1, 0);
+		}
+	}
+	// So may notes whose off was not scheduled yet.
+	for (size_t slot = 0; slot < VOICE_SLOTS; ++slot) {
+		if (soundingTrack_[slot] != NO_TRACK) {
+			routeToDestination(soundingDestination_[slot]);
+			output_->sendNoteOff(static_cast<uint8_t>(slot / 128), static_cast<uint8_t>(slot % 128), 0);
 		}
 	}
+	return position;
 }
 
 } // namespace linearseq
@@ -1,29 +1,66 @@
 #pragma once
 
+#include <array>
 #include <atomic>
 #include <map>
+#include <memory>
 #include <mutex>
+#include <string>
 #include <thread>
 #include <utility>
 #include <vector>
 
 #include "core/Clock.h"
+#include "core/PlaybackQueue.h"
+#include "core/TempoMap.h"
+#include "core/TickSource.h"
+#include "core/TimingStats.h"
 #include "core/Types.h"
 
 namespace linearseq {
 
 class AlsaDriver;
+class MidiOutput;
 
 class Sequencer {
 public:
 	Sequencer();
 	~Sequencer();
 
+	// While playing, the new song is heard from the next tick: its playback stream is
+	// built on the calling thread and swapped in by the tick thread.
 	void setSong(const Song& song);
 	Song song() const;
+	// Mute/solo without a rebuild: heard from the next tick, and notes sounding on a
+	// track that goes silent are released. Queued output applies them from the end of
+	// the scheduled window.
+	void setTrackMute(int index, bool mute);
+	void setTrackSolo(int index, bool solo);
 
+	// Playing from a tick other than 0 first sends the controller, program and pitch
+	// bend state the song has set up by then (found in O(log n) from checkpoints).
+	// With the song's loop enabled and startTick before its end, playback cycles the
+	// loop region seamlessly until stopped; notes still sounding at the loop end are
+	// released there.
 	void play(uint64_t startTick = 0);
 	void stop();
+	// Holds playback where it is: the clock stops and sounding notes are silenced, but
+	// the playback stream, position, loop pass and pending note-offs are kept, so
+	// resume() continues without a rebuild. Edits made while paused are heard on resume.
+	// Ignored while recording. play() and stop() discard the paused state.
+	void pause();
+	void resume();
+	bool isPaused() const;
+	// What resume() does with the notes pause() silenced: strike them again (with
+	// their original velocity) or leave them out until their next note-on.
+	enum class ResumePolicy {
+		Retrigger,
+		Drop
+	};
+	void setResumePolicy(ResumePolicy policy);
+	ResumePolicy resumePolicy() const;
+	// Jump while playing: flushes scheduled output and silences notes, then resumes at tick.
+	void seek(uint64_t tick);
 	bool isPlaying() const;
 	bool shouldStop() const;
 	void allNotesOff();
@@ -35,52 +72,216 @@ public:
 	void setActiveTrack(int index);
 	int activeTrack() const;
 
+    // Song position; while looping, within the loop region. Held while paused.
     uint64_t currentTick() const;
 
+	// The driver is used for recording input and, unless setOutput() overrides it, for output.
 	void setDriver(AlsaDriver* driver);
+	void setOutput(MidiOutput* output);
 
-private:
-	void onTick(uint64_t tick);
-	void recordLoop();
-	void buildPlaybackQueue();
+	// Drive playback from another TickSource (e.g. a VirtualClock for offline rendering).
+	// nullptr restores the internal realtime clock. Ignored while playing or paused.
+	void setTickSource(TickSource* source);
+	TickSource* tickSource() const;
 
-	struct PendingNoteOff {
-		uint64_t tick = 0;
-		uint8_t channel = 0;
-		uint8_t note = 0;
-		uint8_t velocity = 0;
+	// EveryTick (default) or NextEvent, where the clock sleeps until nextDueTick().
+	void setClockMode(Clock::Mode mode);
+	Clock::Mode clockMode() const;
+
+	// Direct sends each event from the clock thread when it falls due. Queued pushes
+	// events lookAheadMs ahead onto an ALSA queue with tick timestamps, so the clock
+	// thread only wakes every half window. Both take effect on the next play().
+	enum class OutputMode {
+		Direct,
+		Queued
 	};
+	void setOutputMode(OutputMode mode);
+	OutputMode outputMode() const;
+	void setLookAheadMs(uint32_t ms);
+	uint32_t lookAheadMs() const;
 
-	struct PlaybackEvent {
-		uint64_t absTick = 0;
-		uint32_t duration = 0;
-		MidiStatus status = MidiStatus::NoteOn;
-		uint8_t channel = 0;
-		uint8_t data1 = 0;
-		uint8_t data2 = 0;
-
-		bool operator<(const PlaybackEvent& other) const {
-			return absTick < other.absTick;
-		}
+	// Direct output when the clock thread was held up and events fall due more than
+	// lateThresholdMs behind. Burst sends them all at once. DropNotes skips their
+	// note-ons (and so their offs) but still sends controllers, programs, bends and the
+	// offs of sounding notes, so channel state stays right. Compress has the realtime
+	// clock deliver the overdue ticks at Clock::COMPRESS_RATE times their tempo until it
+	// has caught up. Counted in clockStats(). Takes effect on the next play().
+	enum class LatePolicy {
+		Burst,
+		DropNotes,
+		Compress
 	};
+	void setLatePolicy(LatePolicy policy);
+	LatePolicy latePolicy() const;
+	void setLateThresholdMs(uint32_t ms);
+	uint32_t lateThresholdMs() const;
+
+	// Internal (default) or MidiClock: follow 0xF8 clock and Start/Stop/Continue/Song
+	// Position Pointer from the MIDI input. Switching stops playback; while following,
+	// playback uses direct output and is started and stopped by the master.
+	void setSyncSource(Clock::SyncSource source);
+	Clock::SyncSource syncSource() const;
+	MidiClockSync::Status syncStatus() const;
+
+	// Emit 24-PPQN MIDI clock plus Start/Continue/Stop/Song Position Pointer on the
+	// output's clock port. Pulses are sent from the tick callback (or scheduled on the
+	// ALSA queue) on the same deadlines as notes. Takes effect on the next play().
+	void setSendMidiClock(bool enabled);
+	bool sendMidiClock() const;
+
+	// Tempo map of the current song, shared with the tick source. While looping its
+	// ticks past the loop end continue with the loop's tempo (see TempoMap::looped).
+	std::shared_ptr<const TempoMap> tempoMap() const;
+
+	const ClockStats& clockStats() const;
+	void resetClockStats();
+	bool dumpClockStats(const std::string& path) const;
+
+	// How late each event was handed to the output (direct output), by event type and
+	// track, with queue depth and pending note-offs. Reset by play().
+	const DispatchStats& dispatchStats() const;
+	void resetDispatchStats();
+	bool dumpDispatchStats(const std::string& path) const;
+
+private:
+	// Tick paths, bound to the tick source by play() so the per-tick code carries no
+	// mode checks. dispatchTick is direct output, specialized for MIDI clock on/off.
+	TickSink selectTickSink();
+	template <bool ClockOut>
+	void dispatchTick(uint64_t tick);
+	uint64_t nextDueTick(uint64_t tick);
+	uint64_t nextRefillTick(uint64_t tick);
+	void inputLoop();
+	void recordEvent(const MidiEvent& inputEvent);
+	void handleSyncMessage(const MidiEvent& message, int64_t receivedNs);
+	void startInput();
+	void stopInputIfIdle();
+	void buildPlaybackQueue();
+	// Output destination of each track. Ports are only added (addMissing) while the
+	// tick source is stopped; otherwise tracks on a port not yet added fall back to 0.
+	std::vector<uint16_t> trackDestinations(const Song& song, bool addMissing);
+	void routeTo(uint16_t track);
+	void routeToDestination(uint16_t destination);
+	void recordDispatch(const PlaybackEvent& event, uint64_t tick);
+	size_t eventsAhead(uint64_t tick) const;
+	void publishSnapshot(std::unique_ptr<PlaybackSnapshot> snapshot);
+	void adoptPendingSnapshot(uint64_t tick);
+	void releaseVoice(size_t slot, uint64_t tick);
+	void takeVoice(const PlaybackEvent& event);
+	// Marks slot as held by track's note, sent to the current destination.
+	void holdVoice(size_t slot, uint16_t track);
+	void freeVoice(size_t slot);
+	void retriggerHeldNotes();
+	void applyTrackMask(uint64_t tick);
+	void startLoop(uint64_t startTick);
+	std::shared_ptr<const TempoMap> playbackTempoMap() const;
+	uint64_t loopPassEnd() const;
+	uint64_t songPosition(uint64_t tick) const;
+	void wrapLoop();
+	bool hasPendingChange() const;
+	void updateTrackState(int index, bool Track::*flag, bool value);
+	void chaseAllDestinations(const ChaseState& state, const ChaseState& previous, bool changesOnly, uint64_t tick);
+	// Sends state now, or at tick when output is queued (tick != NO_TICK). With
+	// changesOnly, values previous already holds are not sent again.
+	void sendChaseState(const ChaseState& state, const ChaseState& previous, bool changesOnly, uint64_t tick);
+	void reclaimSnapshots();
+	bool startQueuedPlayback(uint64_t startTick);
+	void scheduleAhead(uint64_t tick);
+	void scheduleUntil(uint64_t songTick);
+	void scheduleLoopTempo(const TempoMap& map);
+	uint64_t silenceQueuedNotes(); // Returns the tick the queue had reached
+	void startClockOutput(uint64_t startTick);
+	uint64_t clockPulseTick(uint64_t pulse) const;
 
 	mutable std::mutex mutex_;
-	std::mutex pendingMutex_;
-	
+	// Serializes transport changes (play, stop, pause, resume, seek) between the UI
+	// and the MIDI input thread following a clock master. Recursive because seek()
+	// and the sync handlers are built from stop() and play().
+	std::recursive_mutex transportMutex_;
+
 	Song song_;
 	Clock clock_;
+	TickSource* source_;
 	AlsaDriver* driver_;
+	MidiOutput* output_;
 
 	// Playback State
 	std::atomic<bool> playing_;
 	std::atomic<bool> stopRequested_;
-	std::vector<PlaybackEvent> playbackQueue_;
+	// Set by pause(): the source is stopped at pausedTick_ (timeline) with the tick
+	// thread's state below kept as it was.
+	std::atomic<bool> paused_;
+	std::atomic<uint64_t> pausedTick_;
+	std::atomic<ResumePolicy> resumePolicy_;
+	// Whole song with explicit note-offs (see PlaybackQueue::build); the tick path
+	// only advances playbackIndex_ through it. snapshot_ belongs to the tick thread
+	// while playing. setSong() publishes a replacement in pendingSnapshot_, the tick
+	// thread swaps it in and pushes the old one onto retiredSnapshots_, which other
+	// threads free, so nothing is allocated, freed or locked on the tick path.
+	std::unique_ptr<PlaybackSnapshot> snapshot_;
+	// Chased state where playback last stopped: the next start resets what it leaves unset.
+	ChaseState stoppedState_;
+	// Caches per-item runs between builds (setSong while playing, and play()).
+	std::mutex builderMutex_;
+	PlaybackQueueBuilder queueBuilder_;
+	std::atomic<PlaybackSnapshot*> pendingSnapshot_;
+	std::atomic<PlaybackSnapshot*> retiredSnapshots_;
 	size_t playbackIndex_;
-	std::vector<PendingNoteOff> pendingOffs_;
+	// Events before index skipEnd_ with a song tick before skipBefore_ are skipped: an
+	// output offset moved them past the play start (tick thread).
+	uint64_t skipBefore_;
+	size_t skipEnd_;
+	// Track of the note each voice slot has left on (tick thread), or NO_TRACK, and the
+	// destination it went to. Offs go there, even after the track was moved or deleted.
+	static constexpr uint16_t NO_TRACK = 0xFFFF;
+	std::array<uint16_t, VOICE_SLOTS> soundingTrack_;
+	std::array<uint16_t, VOICE_SLOTS> soundingDestination_;
+	// Slots not NO_TRACK, kept by holdVoice()/freeVoice() for the dispatch stats.
+	size_t soundingVoices_;
+	// Output destination last selected on output_ (see routeTo).
+	uint16_t destination_;
+	// Mute/solo state read by the tick path; appliedMaskVersion_ is the version it has
+	// released notes for.
+	TrackMask trackMask_;
+	uint64_t appliedMaskVersion_;
+	// Loop region of the current play(), loopEnd_ 0 when not looping. Source ticks keep
+	// counting past the loop end; loopOffset_ (tick thread) is source tick minus song
+	// tick for the current pass.
+	std::atomic<uint64_t> loopStart_;
+	std::atomic<uint64_t> loopEnd_;
+	uint64_t loopOffset_;
+	uint64_t scheduledTick_; // Queued: first tick not yet on the ALSA queue
+	Clock::Mode clockMode_;
+
+	// Queued output state (owned by the clock thread while playing)
+	std::atomic<OutputMode> outputMode_;
+	std::atomic<uint32_t> lookAheadMs_;
+	OutputMode activeOutputMode_;
+
+	// Late-event handling (latched by play() for the clock thread)
+	std::atomic<LatePolicy> latePolicy_;
+	std::atomic<uint32_t> lateThresholdMs_;
+	bool dropLateNotes_;
+	int64_t lateThresholdNs_;
+	DispatchStats dispatchStats_;
+	std::shared_ptr<const TempoMap> scheduleMap_;
+	uint64_t queueStartTick_;
+	uint64_t nextRefillTick_;
+
+	// MIDI clock output (owned by the clock thread while playing)
+	std::atomic<bool> sendClock_;
+	bool clockOutActive_;
+	uint32_t clockPpqn_;
+	uint64_t nextClockPulse_;
+	uint64_t nextClockTick_;
+
+	// MIDI input (recording and sync), read on one thread
+	std::mutex inputMutex_;
+	std::atomic<bool> inputRunning_;
+	std::thread inputThread_;
 
 	// Recording State
 	std::atomic<bool> recording_;
-	std::thread recordThread_;
 	std::atomic<int> activeTrack_;
 	int recordingTrack_;
 	int recordingItem_;
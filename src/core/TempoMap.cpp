@@ -0,0 +1,185 @@
+#include "core/TempoMap.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace linearseq {
+
+namespace {
+
+constexpr double MICRO_BPM_PER_BPM = 1.0e6;
+
+bool validBpm(double bpm) {
+	return std::isfinite(bpm) && std::llround(bpm * MICRO_BPM_PER_BPM) > 0;
+}
+
+// Nanoseconds spanned by ticks at the given period, floored.
+int64_t ticksToNs(uint64_t ticks, uint64_t periodDenominator) {
+	const unsigned __int128 product = static_cast<unsigned __int128>(ticks) * TempoMap::PERIOD_NUMERATOR;
+	return static_cast<int64_t>(product / periodDenominator);
+}
+
+// Last tick whose start (ticksToNs) is at or before ns, for ns >= 0.
+uint64_t nsToTicks(int64_t ns, uint64_t periodDenominator) {
+	// floor(t * N / D) <= ns  <=>  t * N < (ns + 1) * D
+	const unsigned __int128 limit = static_cast<unsigned __int128>(ns + 1) * periodDenominator;
+	return static_cast<uint64_t>((limit - 1) / TempoMap::PERIOD_NUMERATOR);
+}
+
+} // namespace
+
+TempoMap::TempoMap() : TempoMap(DEFAULT_BPM, DEFAULT_PPQN) {}
+
+TempoMap::TempoMap(double bpm, uint32_t ppqn) : TempoMap(bpm, ppqn, {}) {}
+
+TempoMap::TempoMap(double initialBpm, uint32_t ppqn, const std::vector<TempoEvent>& changes)
+	: ppqn_(ppqn > 0 ? ppqn : DEFAULT_PPQN) {
+	build(initialBpm, changes);
+}
+
+TempoMap TempoMap::fromSong(const Song& song) {
+	return TempoMap(song.bpm, song.ppqn, song.tempoEvents);
+}
+
+TempoMap TempoMap::looped(uint64_t loopStart, uint64_t loopEnd) const {
+	if (loopEnd <= loopStart || loopEnd_ != 0) {
+		return *this;
+	}
+	TempoMap map = *this;
+	while (map.segments_.size() > 1 && map.segments_.back().startTick >= loopEnd) {
+		map.segments_.pop_back();
+	}
+	const size_t first = map.segmentIndexAt(loopStart);
+	if (first + 1 == map.segments_.size()) {
+		return map; // A constant tempo across the loop simply continues
+	}
+	map.loopStart_ = loopStart;
+	map.loopEnd_ = loopEnd;
+	map.loopStartNs_ = map.tickToNs(loopStart);
+	// Sum each segment's exact share of the pass, whole and fractional nanoseconds apart.
+	int64_t whole = 0;
+	unsigned __int128 fraction = 0;
+	for (size_t i = first; i < map.segments_.size(); ++i) {
+		const Segment& segment = map.segments_[i];
+		const uint64_t from = std::max(loopStart, segment.startTick);
+		const uint64_t to = i + 1 < map.segments_.size() ? map.segments_[i + 1].startTick : loopEnd;
+		const unsigned __int128 product = static_cast<unsigned __int128>(to - from) * PERIOD_NUMERATOR;
+		whole += static_cast<int64_t>(product / segment.periodDenominator);
+		fraction += (product % segment.periodDenominator << 64) / segment.periodDenominator;
+	}
+	map.passNs_ = whole + static_cast<int64_t>(fraction >> 64);
+	map.passFraction_ = static_cast<uint64_t>(fraction);
+	return map;
+}
+
+uint64_t TempoMap::loopStart() const {
+	return loopStart_;
+}
+
+uint64_t TempoMap::loopEnd() const {
+	return loopEnd_;
+}
+
+uint64_t TempoMap::foldTick(uint64_t tick) const {
+	if (loopEnd_ == 0 || tick < loopEnd_) {
+		return tick;
+	}
+	return loopStart_ + (tick - loopStart_) % (loopEnd_ - loopStart_);
+}
+
+int64_t TempoMap::passesToNs(uint64_t passes) const {
+	const unsigned __int128 fraction = static_cast<unsigned __int128>(passes) * passFraction_;
+	return static_cast<int64_t>(passes) * passNs_ + static_cast<int64_t>(fraction >> 64);
+}
+
+void TempoMap::build(double initialBpm, const std::vector<TempoEvent>& changes) {
+	std::vector<TempoEvent> sorted;
+	sorted.reserve(changes.size() + 1);
+	sorted.push_back({0, validBpm(initialBpm) ? initialBpm : DEFAULT_BPM});
+	for (const auto& change : changes) {
+		if (validBpm(change.bpm)) {
+			sorted.push_back(change);
+		}
+	}
+	// Stable so that a change at tick 0 overrides Song::bpm, and later entries win ties.
+	std::stable_sort(sorted.begin(), sorted.end(), [](const TempoEvent& a, const TempoEvent& b) {
+		return a.tick < b.tick;
+	});
+
+	segments_.clear();
+	segments_.reserve(sorted.size());
+	for (const auto& change : sorted) {
+		if (!segments_.empty() && segments_.back().startTick == change.tick) {
+			segments_.pop_back();
+		}
+		if (!segments_.empty() && segments_.back().bpm == change.bpm) {
+			continue;
+		}
+
+		Segment segment;
+		segment.startTick = change.tick;
+		segment.startNs = segments_.empty() ? 0 : tickToNs(change.tick);
+		segment.bpm = change.bpm;
+		segment.periodDenominator = static_cast<uint64_t>(std::llround(change.bpm * MICRO_BPM_PER_BPM)) * ppqn_;
+		segments_.push_back(segment);
+	}
+}
+
+uint32_t TempoMap::ppqn() const {
+	return ppqn_;
+}
+
+const std::vector<TempoMap::Segment>& TempoMap::segments() const {
+	return segments_;
+}
+
+size_t TempoMap::segmentIndexAt(uint64_t tick) const {
+	tick = foldTick(tick);
+	auto it = std::upper_bound(segments_.begin(), segments_.end(), tick,
+		[](uint64_t value, const Segment& segment) { return value < segment.startTick; });
+	return it == segments_.begin() ? 0 : static_cast<size_t>(it - segments_.begin()) - 1;
+}
+
+const TempoMap::Segment& TempoMap::segmentAt(uint64_t tick) const {
+	return segments_[segmentIndexAt(tick)];
+}
+
+double TempoMap::bpmAt(uint64_t tick) const {
+	return segmentAt(tick).bpm;
+}
+
+int64_t TempoMap::tickToNs(uint64_t tick) const {
+	const uint64_t folded = foldTick(tick);
+	const Segment& segment = segmentAt(folded);
+	const int64_t ns = segment.startNs + ticksToNs(folded - segment.startTick, segment.periodDenominator);
+	return folded == tick ? ns : ns + passesToNs((tick - loopStart_) / (loopEnd_ - loopStart_));
+}
+
+uint64_t TempoMap::nsToTick(int64_t ns) const {
+	if (ns <= 0) {
+		return 0;
+	}
+	if (loopEnd_ != 0 && ns - loopStartNs_ >= passesToNs(1)) {
+		// Whole passes first (estimated, then corrected for the fraction), then the
+		// position inside the loop.
+		const int64_t sinceStart = ns - loopStartNs_;
+		uint64_t passes = static_cast<uint64_t>(sinceStart / (passNs_ + 1));
+		while (passesToNs(passes + 1) <= sinceStart) {
+			++passes;
+		}
+		const uint64_t inLoop = std::min(nsToTick(loopStartNs_ + sinceStart - passesToNs(passes)), loopEnd_ - 1);
+		return inLoop + passes * (loopEnd_ - loopStart_);
+	}
+	auto it = std::upper_bound(segments_.begin(), segments_.end(), ns,
+		[](int64_t value, const Segment& segment) { return value < segment.startNs; });
+	const Segment& segment = it == segments_.begin() ? segments_.front() : *(it - 1);
+	const uint64_t tick = segment.startTick + nsToTicks(ns - segment.startNs, segment.periodDenominator);
+	return loopEnd_ != 0 ? std::min(tick, loopEnd_ - 1) : tick;
+}
+
+double TempoMap::nsPerTickAt(uint64_t tick) const {
+	return static_cast<double>(PERIOD_NUMERATOR) / static_cast<double>(segmentAt(tick).periodDenominator);
+}
+
+} // namespace linearseq
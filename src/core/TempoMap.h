@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "core/Types.h"
+
+namespace linearseq {
+
+// Piecewise-constant tempo over the song timeline, precomputed into segments so
+// tick <-> nanosecond conversion is a binary search plus one multiply.
+// Time 0 is tick 0.
+//
+// Conversions are exact integer arithmetic: within a segment the time of a tick is
+// (tick - startTick) * PERIOD_NUMERATOR / periodDenominator, computed from the segment
+// start rather than accumulated, so rounding never exceeds 1 ns however long the song.
+// Tempo is quantized to 1e-6 BPM for this.
+class TempoMap {
+public:
+	// Nanoseconds per minute times micro-BPM per BPM.
+	static constexpr uint64_t PERIOD_NUMERATOR = 60000000000ULL * 1000000ULL;
+
+	struct Segment {
+		uint64_t startTick = 0;
+		int64_t startNs = 0;
+		double bpm = DEFAULT_BPM;
+		uint64_t periodDenominator = 1; // micro-BPM * PPQN: one tick is NUMERATOR / this ns
+	};
+
+	TempoMap();
+	TempoMap(double bpm, uint32_t ppqn);
+	TempoMap(double initialBpm, uint32_t ppqn, const std::vector<TempoEvent>& changes);
+
+	static TempoMap fromSong(const Song& song);
+
+	// Map for playback that cycles [loopStart, loopEnd): past loopEnd, ticks keep
+	// counting up while the tempo repeats that of the loop. A constant tempo across the
+	// loop simply continues; otherwise ticks past loopEnd fold back into the loop (see
+	// foldTick) and each pass takes the loop's exact duration, for any number of passes.
+	TempoMap looped(uint64_t loopStart, uint64_t loopEnd) const;
+
+	// Loop the map cycles, loopEnd() 0 when it does not (see looped).
+	uint64_t loopStart() const;
+	uint64_t loopEnd() const;
+	// Tick within the segments with the same tempo as tick: itself before the loop end,
+	// else its position in the loop.
+	uint64_t foldTick(uint64_t tick) const;
+
+	uint32_t ppqn() const;
+	// Segments up to the loop end; the loop's repeat past it is implicit.
+	const std::vector<Segment>& segments() const;
+
+	// Index of the segment containing tick (folded).
+	size_t segmentIndexAt(uint64_t tick) const;
+	const Segment& segmentAt(uint64_t tick) const;
+	double bpmAt(uint64_t tick) const;
+
+	// Start of tick (floor to whole nanoseconds).
+	int64_t tickToNs(uint64_t tick) const;
+	// Last tick at or before ns (0 for negative ns); nsToTick(tickToNs(t)) == t.
+	uint64_t nsToTick(int64_t ns) const;
+	// Nominal tick period of the segment containing tick, for display and tuning.
+	double nsPerTickAt(uint64_t tick) const;
+
+private:
+	void build(double initialBpm, const std::vector<TempoEvent>& changes);
+	// Time of the first tick of pass passes after the loop start, minus loopStartNs_.
+	int64_t passesToNs(uint64_t passes) const;
+
+	uint32_t ppqn_;
+	std::vector<Segment> segments_;
+	uint64_t loopStart_ = 0;
+	uint64_t loopEnd_ = 0;
+	int64_t loopStartNs_ = 0;
+	// Exact duration of one pass: whole nanoseconds plus a 2^-64 ns fraction, so pass
+	// starts do not drift by the rounding of each one.
+	int64_t passNs_ = 0;
+	uint64_t passFraction_ = 0;
+};
+
+} // namespace linearseq
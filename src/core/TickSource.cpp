@@ -0,0 +1,31 @@
+#include "core/TickSource.h"
+
+namespace linearseq {
+
+void TickSource::setTickCallback(TickCallback cb) {
+	callback_ = std::move(cb);
+	applyFunctionSink();
+}
+
+void TickSource::setNextTickQuery(NextTickQuery query) {
+	query_ = std::move(query);
+	applyFunctionSink();
+}
+
+void TickSource::applyFunctionSink() {
+	TickSink sink;
+	sink.context = this;
+	if (callback_) {
+		sink.onTick = [](void* context, uint64_t tick) {
+			static_cast<TickSource*>(context)->callback_(tick);
+		};
+	}
+	if (query_) {
+		sink.nextTick = [](void* context, uint64_t tick) {
+			return static_cast<TickSource*>(context)->query_(tick);
+		};
+	}
+	setTickSink(sink);
+}
+
+} // namespace linearseq
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+
+#include "core/TempoMap.h"
+
+namespace linearseq {
+
+// Allocation-free tick consumer: plain function pointers and a context pointer, so a
+// source calls straight into the consumer with no std::function in between.
+struct TickSink {
+	using TickFn = void (*)(void* context, uint64_t tick);
+	// Next tick the consumer needs after tick. Optional: without it every tick is due.
+	using NextTickFn = uint64_t (*)(void* context, uint64_t tick);
+
+	void* context = nullptr;
+	TickFn onTick = nullptr;
+	NextTickFn nextTick = nullptr;
+
+	// Binds member functions at compile time. The generated trampolines call the members
+	// directly, so the compiler can inline the consumer's (possibly templated) tick path.
+	template <typename T, void (T::*OnTick)(uint64_t), uint64_t (T::*NextTick)(uint64_t) = nullptr>
+	static TickSink bind(T* target) {
+		TickSink sink;
+		sink.context = target;
+		sink.onTick = [](void* context, uint64_t tick) {
+			(static_cast<T*>(context)->*OnTick)(tick);
+		};
+		if constexpr (NextTick != nullptr) {
+			sink.nextTick = [](void* context, uint64_t tick) {
+				return (static_cast<T*>(context)->*NextTick)(tick);
+			};
+		}
+		return sink;
+	}
+};
+
+// Something that advances song ticks and calls a consumer for the ticks it needs.
+// Clock does this in real time on its own thread; VirtualClock does it as fast as
+// the consumer can keep up, on the caller's thread.
+class TickSource {
+public:
+	using TickCallback = std::function<void(uint64_t)>;
+	// Returns the next tick the consumer needs to run at, given the tick it just processed.
+	using NextTickQuery = std::function<uint64_t(uint64_t)>;
+
+	static constexpr uint64_t NO_TICK = std::numeric_limits<uint64_t>::max();
+
+	virtual ~TickSource() = default;
+
+	virtual void setTempoMap(std::shared_ptr<const TempoMap> map) = 0;
+	virtual std::shared_ptr<const TempoMap> tempoMap() const = 0;
+
+	virtual void start(uint64_t startTick = 0) = 0;
+	virtual void stop() = 0;
+	virtual bool isRunning() const = 0;
+	virtual void seek(uint64_t tick) = 0;
+	// Re-query the next due tick (call when the consumer's schedule changed).
+	virtual void wake() = 0;
+
+	// Not synchronized with the ticking thread: set while stopped.
+	virtual void setTickSink(const TickSink& sink) = 0;
+	// std::function adapters over setTickSink(), for tests and tools; each call
+	// replaces the current sink.
+	void setTickCallback(TickCallback cb);
+	void setNextTickQuery(NextTickQuery query);
+
+	virtual uint64_t currentTick() const = 0;
+	// How far past its deadline the tick being delivered is, in nanoseconds (0 when on
+	// time). Only meaningful from inside the tick callback.
+	virtual int64_t tickLatenessNs() const {
+		return 0;
+	}
+	// As tickLatenessNs(), for a tick at or before the one being delivered (an event
+	// held over from an earlier tick). The default ignores the difference.
+	virtual int64_t tickLatenessNs(uint64_t /*tick*/) const {
+		return tickLatenessNs();
+	}
+
+private:
+	void applyFunctionSink();
+
+	TickCallback callback_;
+	NextTickQuery query_;
+};
+
+} // namespace linearseq
@@ -0,0 +1,255 @@
+#include "core/TimingStats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
+namespace linearseq {
+
+namespace {
+
+int magnitudeOf(uint64_t value) {
+	return 63 - __builtin_clzll(value);
+}
+
+void raiseTo(std::atomic<uint64_t>& maximum, uint64_t value) {
+	uint64_t current = maximum.load(std::memory_order_relaxed);
+	while (value > current && !maximum.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+	}
+}
+
+void writeSummary(std::ostream& out, const std::string& name, const LatencyHistogram::Summary& summary) {
+	out << name
+		<< " count=" << summary.count
+		<< " mean_ns=" << static_cast<uint64_t>(summary.meanNs)
+		<< " p50_ns=" << summary.p50Ns
+		<< " p99_ns=" << summary.p99Ns
+		<< " p99.9_ns=" << summary.p999Ns
+		<< " max_ns=" << summary.maxNs
+		<< "\n";
+}
+
+} // namespace
+
+LatencyHistogram::LatencyHistogram() : count_(0), sumNs_(0), maxNs_(0) {
+	for (auto& bucket : buckets_) {
+		bucket.store(0, std::memory_order_relaxed);
+	}
+}
+
+int LatencyHistogram::bucketIndex(uint64_t valueNs) {
+	if (valueNs < SUB_BUCKETS) {
+		return static_cast<int>(valueNs);
+	}
+	const int magnitude = magnitudeOf(valueNs);
+	if (magnitude > MAX_MAGNITUDE) {
+		return BUCKET_COUNT - 1;
+	}
+	const int shift = magnitude - SUB_BUCKET_BITS;
+	const int sub = static_cast<int>((valueNs >> shift) & (SUB_BUCKETS - 1));
+	return (shift + 1) * SUB_BUCKETS + sub;
+}
+
+uint64_t LatencyHistogram::bucketLowerBound(int index) {
+	if (index < SUB_BUCKETS) {
+		return static_cast<uint64_t>(index);
+	}
+	const int shift = index / SUB_BUCKETS - 1;
+	const uint64_t sub = static_cast<uint64_t>(index % SUB_BUCKETS);
+	return (SUB_BUCKETS + sub) << shift;
+}
+
+uint64_t LatencyHistogram::bucketUpperBound(int index) {
+	if (index < SUB_BUCKETS) {
+		return static_cast<uint64_t>(index);
+	}
+	const int shift = index / SUB_BUCKETS - 1;
+	return bucketLowerBound(index) + (uint64_t{1} << shift) - 1;
+}
+
+void LatencyHistogram::record(uint64_t valueNs) {
+	buckets_[bucketIndex(valueNs)].fetch_add(1, std::memory_order_relaxed);
+	count_.fetch_add(1, std::memory_order_relaxed);
+	sumNs_.fetch_add(valueNs, std::memory_order_relaxed);
+	raiseTo(maxNs_, valueNs);
+}
+
+void LatencyHistogram::reset() {
+	for (auto& bucket : buckets_) {
+		bucket.store(0, std::memory_order_relaxed);
+	}
+	count_.store(0, std::memory_order_relaxed);
+	sumNs_.store(0, std::memory_order_relaxed);
+	maxNs_.store(0, std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::count() const {
+	return count_.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::percentile(double fraction) const {
+	// Sum the buckets rather than trusting count_, which may be mid-update.
+	uint64_t total = 0;
+	for (const auto& bucket : buckets_) {
+		total += bucket.load(std::memory_order_relaxed);
+	}
+	if (total == 0) {
+		return 0;
+	}
+	const uint64_t rank = std::max<uint64_t>(1,
+		static_cast<uint64_t>(std::ceil(std::clamp(fraction, 0.0, 1.0) * static_cast<double>(total))));
+	uint64_t seen = 0;
+	for (int i = 0; i < BUCKET_COUNT; ++i) {
+		seen += buckets_[i].load(std::memory_order_relaxed);
+		if (seen >= rank) {
+			return std::min(bucketUpperBound(i), maxNs_.load(std::memory_order_relaxed));
+		}
+	}
+	return maxNs_.load(std::memory_order_relaxed);
+}
+
+LatencyHistogram::Summary LatencyHistogram::summary() const {
+	Summary summary;
+	summary.count = count();
+	summary.p50Ns = percentile(0.50);
+	summary.p99Ns = percentile(0.99);
+	summary.p999Ns = percentile(0.999);
+	summary.maxNs = maxNs_.load(std::memory_order_relaxed);
+	if (summary.count > 0) {
+		summary.meanNs = static_cast<double>(sumNs_.load(std::memory_order_relaxed)) /
+			static_cast<double>(summary.count);
+	}
+	return summary;
+}
+
+void LatencyHistogram::writeBuckets(std::ostream& out) const {
+	for (int i = 0; i < BUCKET_COUNT; ++i) {
+		const uint64_t n = buckets_[i].load(std::memory_order_relaxed);
+		if (n > 0) {
+			out << bucketLowerBound(i) << " " << bucketUpperBound(i) << " " << n << "\n";
+		}
+	}
+}
+
+void ClockStats::reset() {
+	wakeLateness.reset();
+	callbackDuration.reset();
+	overruns.store(0, std::memory_order_relaxed);
+	lateWakeups.store(0, std::memory_order_relaxed);
+	lateEvents.store(0, std::memory_order_relaxed);
+	droppedNotes.store(0, std::memory_order_relaxed);
+	compressedTicks.store(0, std::memory_order_relaxed);
+}
+
+void ClockStats::write(std::ostream& out) const {
+	writeSummary(out, "wake_lateness", wakeLateness.summary());
+	writeSummary(out, "callback_duration", callbackDuration.summary());
+	out << "overruns=" << overruns.load(std::memory_order_relaxed)
+		<< " late_wakeups=" << lateWakeups.load(std::memory_order_relaxed) << "\n";
+	out << "late_events=" << lateEvents.load(std::memory_order_relaxed)
+		<< " dropped_notes=" << droppedNotes.load(std::memory_order_relaxed)
+		<< " compressed_ticks=" << compressedTicks.load(std::memory_order_relaxed) << "\n";
+	out << "\n# wake_lateness buckets: lower_ns upper_ns count\n";
+	wakeLateness.writeBuckets(out);
+	out << "\n# callback_duration buckets: lower_ns upper_ns count\n";
+	callbackDuration.writeBuckets(out);
+}
+
+bool ClockStats::dumpToFile(const std::string& path) const {
+	std::ofstream file(path, std::ios::trunc);
+	if (!file) {
+		return false;
+	}
+	write(file);
+	return static_cast<bool>(file);
+}
+
+DispatchStats::DispatchStats() : byTrack(MAX_TRACKS) {}
+
+DispatchStats::Kind DispatchStats::kindOf(MidiStatus status) {
+	switch (status) {
+		case MidiStatus::NoteOff:
+			return NoteOff;
+		case MidiStatus::ControlChange:
+			return ControlChange;
+		case MidiStatus::ProgramChange:
+			return ProgramChange;
+		case MidiStatus::PitchBend:
+			return PitchBend;
+		default:
+			return NoteOn;
+	}
+}
+
+const char* DispatchStats::kindName(Kind kind) {
+	static const char* const names[KIND_COUNT] = {
+		"note_on", "note_off", "control_change", "program_change", "pitch_bend"};
+	return names[kind];
+}
+
+void DispatchStats::record(Kind kind, size_t track, uint64_t lateNs) {
+	byKind[kind].record(lateNs);
+	byTrack[std::min(track, MAX_TRACKS - 1)].record(lateNs);
+	events.fetch_add(1, std::memory_order_relaxed);
+	if (lateNs > LATE_NS) {
+		late.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+void DispatchStats::sample(uint64_t depth, uint64_t noteOffs) {
+	queueDepth.store(depth, std::memory_order_relaxed);
+	pendingNoteOffs.store(noteOffs, std::memory_order_relaxed);
+	raiseTo(maxQueueDepth, depth);
+	raiseTo(maxPendingNoteOffs, noteOffs);
+}
+
+void DispatchStats::reset() {
+	for (auto& histogram : byKind) {
+		histogram.reset();
+	}
+	for (auto& histogram : byTrack) {
+		histogram.reset();
+	}
+	events.store(0, std::memory_order_relaxed);
+	late.store(0, std::memory_order_relaxed);
+	queueDepth.store(0, std::memory_order_relaxed);
+	maxQueueDepth.store(0, std::memory_order_relaxed);
+	pendingNoteOffs.store(0, std::memory_order_relaxed);
+	maxPendingNoteOffs.store(0, std::memory_order_relaxed);
+}
+
+void DispatchStats::write(std::ostream& out) const {
+	out << "dispatch_events=" << events.load(std::memory_order_relaxed)
+		<< " late=" << late.load(std::memory_order_relaxed)
+		<< " queue_depth=" << queueDepth.load(std::memory_order_relaxed)
+		<< " max_queue_depth=" << maxQueueDepth.load(std::memory_order_relaxed)
+		<< " pending_note_offs=" << pendingNoteOffs.load(std::memory_order_relaxed)
+		<< " max_pending_note_offs=" << maxPendingNoteOffs.load(std::memory_order_relaxed) << "\n";
+	for (int kind = 0; kind < KIND_COUNT; ++kind) {
+		writeSummary(out, std::string("dispatch_") + kindName(static_cast<Kind>(kind)), byKind[kind].summary());
+	}
+	for (size_t track = 0; track < byTrack.size(); ++track) {
+		if (byTrack[track].count() > 0) {
+			// The last histogram holds every track from MAX_TRACKS - 1 on.
+			const std::string suffix = track + 1 == MAX_TRACKS ? "_plus" : "";
+			writeSummary(out, "dispatch_track_" + std::to_string(track) + suffix, byTrack[track].summary());
+		}
+	}
+	for (int kind = 0; kind < KIND_COUNT; ++kind) {
+		if (byKind[kind].count() > 0) {
+			out << "\n# dispatch_" << kindName(static_cast<Kind>(kind)) << " buckets: lower_ns upper_ns count\n";
+			byKind[kind].writeBuckets(out);
+		}
+	}
+}
+
+bool DispatchStats::dumpToFile(const std::string& path) const {
+	std::ofstream file(path, std::ios::trunc);
+	if (!file) {
+		return false;
+	}
+	write(file);
+	return static_cast<bool>(file);
+}
+
+} // namespace linearseq
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "core/Types.h"
+
+namespace linearseq {
+
+// Fixed-size log-linear histogram of nanosecond durations.
+// record() is wait-free and safe to call from the realtime thread; count(),
+// percentile() and summary() may be read from any thread and never block the writer.
+class LatencyHistogram {
+public:
+	// 16 sub-buckets per power of two: <= 6.25% relative error. Buckets cover values
+	// below 2^41 ns (~36 minutes); anything longer is counted in the last one.
+	static constexpr int SUB_BUCKET_BITS = 4;
+	static constexpr int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+	static constexpr int MAX_MAGNITUDE = 40;
+	static constexpr int BUCKET_COUNT = (MAX_MAGNITUDE - SUB_BUCKET_BITS + 2) * SUB_BUCKETS;
+
+	struct Summary {
+		uint64_t count = 0;
+		uint64_t p50Ns = 0;
+		uint64_t p99Ns = 0;
+		uint64_t p999Ns = 0;
+		uint64_t maxNs = 0;
+		double meanNs = 0.0;
+	};
+
+	LatencyHistogram();
+
+	void record(uint64_t valueNs);
+	void reset();
+
+	uint64_t count() const;
+	uint64_t percentile(double fraction) const;
+	Summary summary() const;
+
+	// One "lower_ns upper_ns count" line per non-empty bucket.
+	void writeBuckets(std::ostream& out) const;
+
+	static int bucketIndex(uint64_t valueNs);
+	static uint64_t bucketLowerBound(int index);
+	static uint64_t bucketUpperBound(int index);
+
+private:
+	std::array<std::atomic<uint64_t>, BUCKET_COUNT> buckets_;
+	std::atomic<uint64_t> count_;
+	std::atomic<uint64_t> sumNs_;
+	std::atomic<uint64_t> maxNs_;
+};
+
+// Per-tick timing of the clock thread.
+struct ClockStats {
+	LatencyHistogram wakeLateness;     // actual wakeup - tick deadline
+	LatencyHistogram callbackDuration; // time spent in the tick callback
+	std::atomic<uint64_t> overruns{0}; // callback finished after the next tick's deadline
+	std::atomic<uint64_t> lateWakeups{0}; // woke more than LATE_WAKEUP_NS after the deadline
+
+	// Late events, as handled by the tick consumer's policy (see Sequencer::LatePolicy)
+	std::atomic<uint64_t> lateEvents{0};      // events sent past the late threshold
+	std::atomic<uint64_t> droppedNotes{0};    // late note-ons skipped
+	std::atomic<uint64_t> compressedTicks{0}; // ticks held back to spread a backlog (Clock::CatchUp)
+
+	static constexpr uint64_t LATE_WAKEUP_NS = 1000000;
+
+	void reset();
+	void write(std::ostream& out) const;
+	bool dumpToFile(const std::string& path) const;
+};
+
+// Per-event timing of the sequencer's direct output: how long after its ideal time
+// each event was handed to the output, by event type and by track, plus gauges of what
+// is in flight. Written by the tick thread only; readable from any thread.
+struct DispatchStats {
+	enum Kind {
+		NoteOn,
+		NoteOff,
+		ControlChange,
+		ProgramChange,
+		PitchBend,
+		KIND_COUNT
+	};
+	// Tracks from MAX_TRACKS - 1 on share the last histogram, dumped as dispatch_track_63_plus.
+	static constexpr size_t MAX_TRACKS = 64;
+	static constexpr uint64_t LATE_NS = 1000000;
+
+	std::array<LatencyHistogram, KIND_COUNT> byKind;
+	std::vector<LatencyHistogram> byTrack; // MAX_TRACKS, on the heap
+	std::atomic<uint64_t> events{0};
+	std::atomic<uint64_t> late{0}; // handed over more than LATE_NS after the ideal time
+	// Events handed to the output and not yet delivered: the tick's batch for direct
+	// output, the look-ahead window on the ALSA queue for queued output.
+	std::atomic<uint64_t> queueDepth{0};
+	std::atomic<uint64_t> maxQueueDepth{0};
+	std::atomic<uint64_t> pendingNoteOffs{0}; // sounding notes awaiting their off
+	std::atomic<uint64_t> maxPendingNoteOffs{0};
+
+	DispatchStats();
+
+	static Kind kindOf(MidiStatus status);
+	static const char* kindName(Kind kind);
+
+	void record(Kind kind, size_t track, uint64_t lateNs);
+	void sample(uint64_t depth, uint64_t noteOffs);
+	void reset();
+	void write(std::ostream& out) const;
+	bool dumpToFile(const std::string& path) const;
+};
+
+} // namespace linearseq
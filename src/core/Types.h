@@ -13,7 +13,13 @@ enum class MidiStatus : uint8_t {
 	ControlChange = 0xB0,
 	ProgramChange = 0xC0,
 	ChannelAftertouch = 0xD0,
-	PitchBend = 0xE0
+	PitchBend = 0xE0,
+	// System messages, only seen on MIDI input (never stored in songs)
+	SongPosition = 0xF2, // data1/data2 = 14-bit position in 16th notes (LSB, MSB)
+	TimingClock = 0xF8,
+	Start = 0xFA,
+	Continue = 0xFB,
+	Stop = 0xFC
 };
 
 constexpr uint32_t DEFAULT_PPQN = 120;
@@ -41,14 +47,36 @@ struct Track {
 	uint8_t channel = 0;
 	bool mute = false; // Mute state for track silencing
 	bool solo = false; // Solo state for track isolation
+	double offsetMs = 0.0; // Output timing offset, added to its port's (see PortOffset)
 	std::vector<MidiItem> items;
 };
 
+// Tempo change taking effect at an absolute song tick.
+struct TempoEvent {
+	uint32_t tick = 0;
+	double bpm = DEFAULT_BPM;
+};
+
+// Output timing offset for every track playing on an ALSA client:port, to line up
+// devices with different input latencies: negative plays earlier, positive later.
+struct PortOffset {
+	int client = -1;
+	int port = -1;
+	double offsetMs = 0.0;
+};
+
 struct Song {
 	uint32_t ppqn = DEFAULT_PPQN;
-	double bpm = DEFAULT_BPM;
+	double bpm = DEFAULT_BPM; // Tempo at tick 0
+	std::vector<TempoEvent> tempoEvents; // Later tempo changes, any order
 	std::string midiDevice;
 	std::vector<Track> tracks;
+	std::vector<PortOffset> portOffsets;
+	// Cycle region [loopStart, loopEnd): when enabled, playback started before loopEnd
+	// wraps back to loopStart instead of running on.
+	bool loopEnabled = false;
+	uint32_t loopStart = 0;
+	uint32_t loopEnd = 0;
 };
 
 } // namespace linearseq
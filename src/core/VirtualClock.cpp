@@ -0,0 +1,120 @@
+#include "core/VirtualClock.h"
+
+#include <algorithm>
+
+namespace linearseq {
+
+VirtualClock::VirtualClock()
+	: map_(std::make_shared<TempoMap>()),
+	  running_(false),
+	  fired_(false),
+	  startTick_(0),
+	  position_(0),
+	  lastTick_(0),
+	  dueTick_(0),
+	  latenessNs_(0) {}
+
+void VirtualClock::setTempoMap(std::shared_ptr<const TempoMap> map) {
+	if (map) {
+		map_ = std::move(map);
+	}
+}
+
+std::shared_ptr<const TempoMap> VirtualClock::tempoMap() const {
+	return map_;
+}
+
+void VirtualClock::start(uint64_t startTick) {
+	if (running_) {
+		return;
+	}
+	running_ = true;
+	fired_ = false;
+	startTick_ = startTick;
+	position_ = startTick;
+	lastTick_ = startTick;
+	dueTick_ = startTick;
+}
+
+void VirtualClock::stop() {
+	running_ = false;
+}
+
+bool VirtualClock::isRunning() const {
+	return running_;
+}
+
+void VirtualClock::seek(uint64_t tick) {
+	position_ = tick;
+	dueTick_ = tick;
+	fired_ = false;
+}
+
+void VirtualClock::wake() {
+	if (fired_ && sink_.nextTick) {
+		dueTick_ = std::max(lastTick_ + 1, sink_.nextTick(sink_.context, lastTick_));
+	}
+}
+
+void VirtualClock::setTickSink(const TickSink& sink) {
+	sink_ = sink;
+}
+
+uint64_t VirtualClock::currentTick() const {
+	return position_;
+}
+
+int64_t VirtualClock::tickLatenessNs() const {
+	return latenessNs_;
+}
+
+int64_t VirtualClock::tickLatenessNs(uint64_t tick) const {
+	return latenessNs_ + (tick < position_ ? map_->tickToNs(position_) - map_->tickToNs(tick) : 0);
+}
+
+uint64_t VirtualClock::advanceTo(uint64_t endTick) {
+	const uint64_t calls = process(endTick);
+	if (running_ && endTick != NO_TICK) {
+		position_ = std::max(position_, endTick);
+	}
+	return calls;
+}
+
+uint64_t VirtualClock::advanceBy(uint64_t ticks) {
+	const uint64_t endTick = ticks > NO_TICK - position_ ? NO_TICK - 1 : position_ + ticks;
+	return advanceTo(endTick);
+}
+
+uint64_t VirtualClock::run(uint64_t endTick) {
+	return process(endTick);
+}
+
+int64_t VirtualClock::positionNs() const {
+	return map_->tickToNs(position_);
+}
+
+int64_t VirtualClock::elapsedNs() const {
+	return map_->tickToNs(position_) - map_->tickToNs(startTick_);
+}
+
+void VirtualClock::setTickLateness(int64_t ns) {
+	latenessNs_ = ns;
+}
+
+uint64_t VirtualClock::process(uint64_t endTick) {
+	uint64_t calls = 0;
+	while (running_ && dueTick_ != NO_TICK && dueTick_ <= endTick) {
+		const uint64_t tick = dueTick_;
+		position_ = tick;
+		if (sink_.onTick) {
+			sink_.onTick(sink_.context, tick);
+		}
+		++calls;
+		lastTick_ = tick;
+		fired_ = true;
+		dueTick_ = sink_.nextTick ? std::max(tick + 1, sink_.nextTick(sink_.context, tick)) : tick + 1;
+	}
+	return calls;
+}
+
+} // namespace linearseq
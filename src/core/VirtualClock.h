@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+#include "core/TickSource.h"
+
+namespace linearseq {
+
+// Offline TickSource for rendering and tests. Nothing happens in the background:
+// ticks are processed on the caller's thread by run() (as fast as the consumer
+// keeps up) or advanceTo()/advanceBy() (caller-controlled steps). Only the ticks
+// the NextTickQuery asks for are visited, so idle stretches cost nothing.
+// Not thread-safe; drive it from one thread.
+class VirtualClock : public TickSource {
+public:
+	VirtualClock();
+
+	void setTempoMap(std::shared_ptr<const TempoMap> map) override;
+	std::shared_ptr<const TempoMap> tempoMap() const override;
+
+	void start(uint64_t startTick = 0) override;
+	void stop() override;
+	bool isRunning() const override;
+	void seek(uint64_t tick) override;
+	void wake() override;
+
+	void setTickSink(const TickSink& sink) override;
+	uint64_t currentTick() const override;
+	// Virtual ticks are never late; this is whatever setTickLateness() last set.
+	int64_t tickLatenessNs() const override;
+	int64_t tickLatenessNs(uint64_t tick) const override;
+
+	// Process every due tick up to and including endTick, then leave the position
+	// at endTick. Returns the number of tick callbacks made.
+	uint64_t advanceTo(uint64_t endTick);
+	uint64_t advanceBy(uint64_t ticks);
+	// Process due ticks until stop(), the consumer reports NO_TICK, or endTick is passed.
+	uint64_t run(uint64_t endTick = NO_TICK);
+
+	// Virtual time of the current position on the tempo map, and since start().
+	int64_t positionNs() const;
+	int64_t elapsedNs() const;
+
+	// Reports every tick from now on as this late, to exercise late-event handling.
+	void setTickLateness(int64_t ns);
+
+private:
+	uint64_t process(uint64_t endTick);
+
+	std::shared_ptr<const TempoMap> map_;
+	TickSink sink_;
+	bool running_;
+	bool fired_;
+	uint64_t startTick_;
+	uint64_t position_;
+	uint64_t lastTick_;
+	uint64_t dueTick_;
+	int64_t latenessNs_;
+};
+
+} // namespace linearseq
@@ -36,11 +36,29 @@ MainToolbar::MainToolbar(int x, int y, int w, int h) : Fl_Group(x, y, w, h) {
         auto* self = static_cast<MainToolbar*>(data);
 		if (self->onFileLoad_) self->onFileLoad_();
 	}, this);
+	fileMenuButton_->add("Export Timing Stats", 0, [](Fl_Widget*, void* data) {
+        auto* self = static_cast<MainToolbar*>(data);
+		if (self->onExportTimingStats_) self->onExportTimingStats_();
+	}, this);
+	fileMenuButton_->add("Track Output Offset...", 0, [](Fl_Widget*, void* data) {
+        auto* self = static_cast<MainToolbar*>(data);
+		if (self->onTrackOutputOffset_) self->onTrackOutputOffset_();
+	}, this);
+	fileMenuButton_->add("Sync to MIDI Clock", 0, [](Fl_Widget* w, void* data) {
+        auto* self = static_cast<MainToolbar*>(data);
+        const Fl_Menu_Item* item = static_cast<Fl_Menu_Button*>(w)->mvalue();
+		if (self->onMidiSyncToggled_ && item) self->onMidiSyncToggled_(item->value() != 0);
+	}, this, FL_MENU_TOGGLE);
+	fileMenuButton_->add("Send MIDI Clock", 0, [](Fl_Widget* w, void* data) {
+        auto* self = static_cast<MainToolbar*>(data);
+        const Fl_Menu_Item* item = static_cast<Fl_Menu_Button*>(w)->mvalue();
+		if (self->onMidiClockOutToggled_ && item) self->onMidiClockOutToggled_(item->value() != 0);
+	}, this, FL_MENU_TOGGLE);
 
 	playButton_ = new Fl_Button(toolX += 20, y + 4, 24, 24, "\uf04b");
     playButton_->labelfont(FL_FREE_FONT);
     playButton_->labelsize(14);
-    playButton_->tooltip("Play");
+    playButton_->tooltip("Play / Pause");
     playButton_->callback([](Fl_Widget*, void* data) {
         auto* self = static_cast<MainToolbar*>(data);
         if (self->onPlay_) self->onPlay_();
@@ -165,6 +183,10 @@ void MainToolbar::setOnDeleteTrack(std::function<void()> cb) { onDeleteTrack_ =
 void MainToolbar::setOnAddItem(std::function<void()> cb) { onAddItem_ = std::move(cb); }
 void MainToolbar::setOnFileSave(std::function<void()> cb) { onFileSave_ = std::move(cb); }
 void MainToolbar::setOnFileLoad(std::function<void()> cb) { onFileLoad_ = std::move(cb); }
+void MainToolbar::setOnExportTimingStats(std::function<void()> cb) { onExportTimingStats_ = std::move(cb); }
+void MainToolbar::setOnTrackOutputOffset(std::function<void()> cb) { onTrackOutputOffset_ = std::move(cb); }
+void MainToolbar::setOnMidiSyncToggled(std::function<void(bool)> cb) { onMidiSyncToggled_ = std::move(cb); }
+void MainToolbar::setOnMidiClockOutToggled(std::function<void(bool)> cb) { onMidiClockOutToggled_ = std::move(cb); }
 void MainToolbar::setOnMidiOutSelect(std::function<void(int)> cb) { onMidiOutSelect_ = std::move(cb); }
 void MainToolbar::setOnBpmChanged(std::function<void(double)> cb) { onBpmChanged_ = std::move(cb); }
 void MainToolbar::setOnPpqnChanged(std::function<void(int)> cb) { onPpqnChanged_ = std::move(cb); }
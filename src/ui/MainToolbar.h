@@ -29,6 +29,10 @@ public:
     void setOnDeleteTrack(std::function<void()> cb);
     void setOnFileSave(std::function<void()> cb);
     void setOnFileLoad(std::function<void()> cb);
+    void setOnExportTimingStats(std::function<void()> cb);
+    void setOnTrackOutputOffset(std::function<void()> cb);
+    void setOnMidiSyncToggled(std::function<void(bool)> cb); // passes new state
+    void setOnMidiClockOutToggled(std::function<void(bool)> cb); // passes new state
     void setOnMidiOutSelect(std::function<void(int)> cb); // passes index
     void setOnBpmChanged(std::function<void(double)> cb);
     void setOnPpqnChanged(std::function<void(int)> cb);
@@ -74,6 +78,10 @@ private:
     std::function<void()> onAddItem_;
     std::function<void()> onFileSave_;
     std::function<void()> onFileLoad_;
+    std::function<void()> onExportTimingStats_;
+    std::function<void()> onTrackOutputOffset_;
+    std::function<void(bool)> onMidiSyncToggled_;
+    std::function<void(bool)> onMidiClockOutToggled_;
     std::function<void(int)> onMidiOutSelect_;
     std::function<void(double)> onBpmChanged_;
     std::function<void(int)> onPpqnChanged_;
@@ -7,11 +7,15 @@
 #include <FL/fl_ask.H>
 
 #include <algorithm>
+#include <cmath>
 #include <cstdint>
+#include <cstdio>
 #include <cstdlib>
 #include <filesystem>
+#include <fstream>
 #include <string>
 
+#include "core/PlaybackQueue.h"
 #include "core/Types.h"
 #include "ui/AppIcon.h"
 #include "ui/EventList.h"
@@ -141,6 +145,10 @@ MainWindow::MainWindow(int w, int h, const char* title)
     toolbar_->setOnAddItem([this] { onAddItem(); });
     toolbar_->setOnFileSave([this] { onFileSave(); });
     toolbar_->setOnFileLoad([this] { onFileLoad(); });
+    toolbar_->setOnExportTimingStats([this] { onExportTimingStats(); });
+    toolbar_->setOnTrackOutputOffset([this] { onTrackOutputOffset(); });
+    toolbar_->setOnMidiSyncToggled([this](bool enabled) { onMidiSyncToggled(enabled); });
+    toolbar_->setOnMidiClockOutToggled([this](bool enabled) { sequencer_.setSendMidiClock(enabled); });
     toolbar_->setOnMidiOutSelect([this](int idx) { onMidiOutSelect(idx); });
     toolbar_->setOnBpmChanged([this](double bpm) { onBpmChanged(bpm); });
     toolbar_->setOnPpqnChanged([this](int ppqn) { onPpqnChanged(ppqn); });
@@ -167,6 +175,19 @@ MainWindow::MainWindow(int w, int h, const char* title)
 	tickDisplay_->labelcolor(FL_WHITE);
 	tickDisplay_->labelsize(12);
 
+	// The space between splits into MIDI sync state and dispatch timing.
+	const int middleWidth = (w - 332) / 2;
+	syncStatus_ = new Fl_Box(166, h - statusBarHeight + 2, middleWidth, statusBarHeight - 4);
+	syncStatus_->align(FL_ALIGN_CENTER | FL_ALIGN_INSIDE);
+	syncStatus_->labelcolor(FL_WHITE);
+	syncStatus_->labelsize(12);
+
+	dispatchStatus_ = new Fl_Box(166 + middleWidth, h - statusBarHeight + 2, w - 332 - middleWidth,
+		statusBarHeight - 4);
+	dispatchStatus_->align(FL_ALIGN_CENTER | FL_ALIGN_INSIDE);
+	dispatchStatus_->labelcolor(FL_WHITE);
+	dispatchStatus_->labelsize(12);
+
 	connectionStatus_ = new Fl_Box(w - 158, h - statusBarHeight + 2, 150, statusBarHeight - 4, "ALSA: unavailable");
 	connectionStatus_->align(FL_ALIGN_RIGHT | FL_ALIGN_INSIDE);
 	connectionStatus_->labelcolor(FL_WHITE);
@@ -196,7 +217,7 @@ MainWindow::MainWindow(int w, int h, const char* title)
 			return;
 		}
 		song_.tracks[index].mute = mute;
-		sequencer_.setSong(song_);
+		sequencer_.setTrackMute(index, mute);
 		trackView_->setSong(song_); // Refresh to update button states
 		setModified(true);
 	});
@@ -206,7 +227,7 @@ MainWindow::MainWindow(int w, int h, const char* title)
 			return;
 		}
 		song_.tracks[index].solo = solo;
-		sequencer_.setSong(song_);
+		sequencer_.setTrackSolo(index, solo);
 		trackView_->setSong(song_); // Refresh to update button states
 		setModified(true);
 	});
@@ -267,6 +288,9 @@ MainWindow::MainWindow(int w, int h, const char* title)
     trackView_->setSetTime([this](uint32_t tick) {
         currentTick_ = tick;
         trackView_->setPlayheadTick(currentTick_);
+        if (sequencer_.isPlaying()) {
+            sequencer_.seek(currentTick_);
+        }
     });
 
 	trackView_->setSelectedTrack(0);
@@ -297,6 +321,7 @@ MainWindow::MainWindow(int w, int h, const char* title)
 }
 
 MainWindow::~MainWindow() {
+	Fl::remove_timeout(syncTimer, this);
 	// Unregister global handler
 	Fl::remove_handler(globalEventHandler);
 	instanceForHandler_ = nullptr;
@@ -556,10 +581,25 @@ void MainWindow::onDelete() {
 }
 
 void MainWindow::onPlay() {
+	// Play toggles pause while playing (not while recording)
+	if (sequencer_.isPlaying() && !sequencer_.isRecording()) {
+		Fl::remove_timeout(playTimer, this);
+		sequencer_.pause();
+		// The timer may lag the pause position; resume only matches it exactly.
+		currentTick_ = static_cast<uint32_t>(sequencer_.currentTick());
+		trackView_->setPlayheadTick(currentTick_);
+		toolbar_->setPlaying(false);
+		return;
+	}
 	ensureDriverOpen();
 	updateStatus();
-	// Start playback from current playhead position
-	sequencer_.play(currentTick_);
+	// Resume unless the playhead was moved while paused.
+	if (sequencer_.isPaused() && sequencer_.currentTick() == currentTick_) {
+		sequencer_.resume();
+	} else {
+		// Start playback from current playhead position
+		sequencer_.play(currentTick_);
+	}
 	toolbar_->setPlaying(true);
     Fl::add_timeout(0.033, playTimer, this);
 }
@@ -605,12 +645,18 @@ void MainWindow::playTimer(void* data) {
     const uint64_t measure = mw->currentTick_ / ticksPerMeasure + 1;
     const uint64_t beat = (mw->currentTick_ / ppqn) % beatsPerMeasure + 1;
     const uint64_t tick = mw->currentTick_ % ppqn;
-    char tickBuf[32];
-    std::snprintf(tickBuf, sizeof(tickBuf), "%llu:%llu:%03llu", 
+    // Wall time at the playhead from the sequencer's tempo map (O(log n) lookup)
+    const int64_t elapsedMs = mw->sequencer_.tempoMap()->tickToNs(mw->currentTick_) / 1000000;
+    char tickBuf[48];
+    std::snprintf(tickBuf, sizeof(tickBuf), "%llu:%llu:%03llu  %lld:%02lld.%03lld", 
         static_cast<unsigned long long>(measure),
         static_cast<unsigned long long>(beat),
-        static_cast<unsigned long long>(tick));
+        static_cast<unsigned long long>(tick),
+        static_cast<long long>(elapsedMs / 60000),
+        static_cast<long long>((elapsedMs / 1000) % 60),
+        static_cast<long long>(elapsedMs % 1000));
     mw->tickDisplay_->copy_label(tickBuf);
+    mw->updateDispatchStatus();
     
     // Auto-scroll when playhead moves past visible area
     if (mw->trackScroll_) {
@@ -921,6 +967,103 @@ void MainWindow::onFileLoad() {
 	setModified(false);
 }
 
+void MainWindow::onExportTimingStats() {
+	Fl_Native_File_Chooser chooser;
+	chooser.title("Export Timing Stats");
+	chooser.type(Fl_Native_File_Chooser::BROWSE_SAVE_FILE);
+	chooser.filter("Text\t*.txt");
+	chooser.options(Fl_Native_File_Chooser::SAVEAS_CONFIRM);
+	if (chooser.show() != 0) {
+		return;
+	}
+	const char* path = chooser.filename();
+	if (!path) {
+		return;
+	}
+	std::ofstream file(path, std::ios::trunc);
+	if (file) {
+		sequencer_.clockStats().write(file);
+		file << "\n";
+		sequencer_.dispatchStats().write(file);
+	}
+	if (!file) {
+		fl_alert("Could not write timing stats to %s", path);
+	}
+}
+
+void MainWindow::onMidiSyncToggled(bool enabled) {
+	if (enabled) {
+		ensureDriverOpen();
+		updateStatus();
+	}
+	onStop();
+	sequencer_.setSyncSource(enabled ? Clock::SyncSource::MidiClock : Clock::SyncSource::Internal);
+	syncPlaying_ = false;
+	Fl::remove_timeout(syncTimer, this);
+	if (enabled) {
+		Fl::add_timeout(0.25, syncTimer, this);
+	}
+	updateSyncStatus();
+}
+
+void MainWindow::syncTimer(void* data) {
+	MainWindow* mw = static_cast<MainWindow*>(data);
+	// The master starts and stops playback; follow it in the toolbar and playhead.
+	const bool playing = mw->sequencer_.isPlaying();
+	if (playing && !Fl::has_timeout(playTimer, mw)) {
+		mw->toolbar_->setPlaying(true);
+		Fl::add_timeout(0.033, playTimer, mw);
+	} else if (!playing && mw->syncPlaying_) {
+		mw->onStop();
+	}
+	mw->syncPlaying_ = playing;
+	mw->updateSyncStatus();
+	Fl::repeat_timeout(0.25, syncTimer, data);
+}
+
+void MainWindow::updateSyncStatus() {
+	if (sequencer_.syncSource() != Clock::SyncSource::MidiClock) {
+		syncStatus_->copy_label("");
+		syncStatus_->redraw();
+		return;
+	}
+	const MidiClockSync::Status status = sequencer_.syncStatus();
+	char buf[128];
+	switch (status.state) {
+		case MidiClockSync::State::Locked:
+			std::snprintf(buf, sizeof(buf), "MIDI Sync: locked %.1f BPM  jitter %.2f ms  err %.2f ms  lock %.2f s",
+				status.bpm, status.jitterMs, status.phaseErrorMs, status.lockTimeMs / 1000.0);
+			syncStatus_->labelcolor(fl_rgb_color(0, 200, 0));
+			break;
+		case MidiClockSync::State::Acquiring:
+			std::snprintf(buf, sizeof(buf), "MIDI Sync: acquiring %.1f BPM  jitter %.2f ms",
+				status.bpm, status.jitterMs);
+			syncStatus_->labelcolor(FL_YELLOW);
+			break;
+		case MidiClockSync::State::Idle:
+		default:
+			std::snprintf(buf, sizeof(buf), "MIDI Sync: no clock");
+			syncStatus_->labelcolor(FL_RED);
+			break;
+	}
+	syncStatus_->copy_label(buf);
+	syncStatus_->redraw();
+}
+
+void MainWindow::updateDispatchStatus() {
+	const DispatchStats& stats = sequencer_.dispatchStats();
+	const LatencyHistogram::Summary notes = stats.byKind[DispatchStats::NoteOn].summary();
+	const uint64_t late = stats.late.load(std::memory_order_relaxed);
+	char buf[128];
+	std::snprintf(buf, sizeof(buf), "Notes p99 %.2f ms  max %.2f ms  late %llu  max queue %llu  pending offs %llu",
+		notes.p99Ns / 1.0e6, notes.maxNs / 1.0e6, static_cast<unsigned long long>(late),
+		static_cast<unsigned long long>(stats.maxQueueDepth.load(std::memory_order_relaxed)),
+		static_cast<unsigned long long>(stats.pendingNoteOffs.load(std::memory_order_relaxed)));
+	dispatchStatus_->labelcolor(late > 0 ? FL_YELLOW : FL_WHITE);
+	dispatchStatus_->copy_label(buf);
+	dispatchStatus_->redraw();
+}
+
 void MainWindow::updateWindowTitle() {
 	std::string title = "LinearSeq";
 	if (!currentFilename_.empty()) {
@@ -966,6 +1109,37 @@ void MainWindow::onTrackPitchShift() {
 	setModified(true);
 	refreshViews();
 }
+void MainWindow::onTrackOutputOffset() {
+	int selectedTrack = trackView_->selectedTrack();
+	if (selectedTrack < 0 || selectedTrack >= static_cast<int>(song_.tracks.size())) {
+		return; // No track selected
+	}
+
+	// Negative plays earlier, to make up for a slow device
+	auto& track = song_.tracks[selectedTrack];
+	char current[32];
+	std::snprintf(current, sizeof(current), "%g", track.offsetMs);
+	const double minMs = PlaybackQueue::minOutputOffsetMs(song_);
+	const char* input = fl_input("Output offset in ms, applied in whole ticks of up to %.2f ms (e.g., -12.5, +4):",
+		current, minMs);
+	if (!input) return; // User cancelled
+
+	char* end = nullptr;
+	const double offsetMs = std::strtod(input, &end);
+	if (end == input || offsetMs == track.offsetMs) return;
+
+	// Shorter offsets (with the port's added) could round to no shift at all.
+	const double totalMs = offsetMs - track.offsetMs + PlaybackQueue::outputOffsetMs(song_, track);
+	if (totalMs != 0.0 && std::fabs(totalMs) < minMs) {
+		fl_alert("An output offset of %g ms is shorter than one tick (%.2f ms at the song's slowest tempo) and would be lost.",
+			totalMs, minMs);
+		return;
+	}
+
+	track.offsetMs = offsetMs;
+	sequencer_.setSong(song_);
+	setModified(true);
+}
 void MainWindow::onClose() {
 	if (modified_) {
 		int choice = fl_choice(
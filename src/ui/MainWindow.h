@@ -31,8 +31,11 @@ private:
 	void onAddItem();
 	void onTrackNameChanged(std::string name);
 	void onTrackPitchShift(); // Shift pitch of selected track by semitones
+	void onTrackOutputOffset(); // Set the selected track's output offset in ms
 	void onFileSave();
 	void onFileLoad();
+	void onExportTimingStats();
+	void onMidiSyncToggled(bool enabled);
 	void onMidiOutSelect(int index);
 	void onBpmChanged(double bpm);
 	void onPpqnChanged(int ppqn);
@@ -44,6 +47,9 @@ private:
 	void normalizeScrollPositions();
 	static void postInitScroll(void* data);
     static void playTimer(void* data);
+	static void syncTimer(void* data);
+	void updateSyncStatus();
+	void updateDispatchStatus(); // Dispatch timing in the status bar while playing
 	void updateChannelInputs();
 	void updateWindowTitle();
 	void setModified(bool modified);
@@ -58,6 +64,8 @@ private:
 	MainToolbar* toolbar_;
     Fl_Box* statusBar_;
     Fl_Box* tickDisplay_;
+    Fl_Box* syncStatus_;
+    Fl_Box* dispatchStatus_;
     Fl_Box* connectionStatus_;
     
 	Fl_Scroll* trackScroll_;
@@ -78,6 +86,7 @@ private:
     
     // Playback state
     uint32_t currentTick_ = 0;
+    bool syncPlaying_ = false; // playback state last seen by syncTimer
     
     // File state
     std::string currentFilename_;
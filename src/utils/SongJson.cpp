@@ -293,6 +293,15 @@ bool getString(const JsonValue::Object& obj, const std::string& key, std::string
 	return true;
 }
 
+bool getBool(const JsonValue::Object& obj, const std::string& key, bool& out) {
+	auto it = obj.find(key);
+	if (it == obj.end() || it->second.type != JsonValue::Type::Bool) {
+		return false;
+	}
+	out = it->second.boolean;
+	return true;
+}
+
 bool getArray(const JsonValue::Object& obj, const std::string& key, JsonValue::Array& out) {
 	auto it = obj.find(key);
 	if (it == obj.end() || it->second.type != JsonValue::Type::Array) {
@@ -309,7 +318,33 @@ std::string toJson(const Song& song) {
 	out << "{";
 	out << "\"ppqn\":" << song.ppqn << ",";
 	out << "\"bpm\":" << song.bpm << ",";
+	out << "\"tempoEvents\":[";
+	for (size_t i = 0; i < song.tempoEvents.size(); ++i) {
+		if (i > 0) {
+			out << ",";
+		}
+		out << "{";
+		out << "\"tick\":" << song.tempoEvents[i].tick << ",";
+		out << "\"bpm\":" << song.tempoEvents[i].bpm;
+		out << "}";
+	}
+	out << "],";
+	out << "\"loopEnabled\":" << (song.loopEnabled ? "true" : "false") << ",";
+	out << "\"loopStart\":" << song.loopStart << ",";
+	out << "\"loopEnd\":" << song.loopEnd << ",";
 	out << "\"midiDevice\":" << escapeString(song.midiDevice) << ",";
+	out << "\"portOffsets\":[";
+	for (size_t i = 0; i < song.portOffsets.size(); ++i) {
+		if (i > 0) {
+			out << ",";
+		}
+		out << "{";
+		out << "\"client\":" << song.portOffsets[i].client << ",";
+		out << "\"port\":" << song.portOffsets[i].port << ",";
+		out << "\"offsetMs\":" << song.portOffsets[i].offsetMs;
+		out << "}";
+	}
+	out << "],";
 	out << "\"tracks\":[";
 	for (size_t t = 0; t < song.tracks.size(); ++t) {
 		const auto& track = song.tracks[t];
@@ -321,6 +356,7 @@ std::string toJson(const Song& song) {
 		out << "\"alsaClient\":" << track.alsaClient << ",";
 		out << "\"alsaPort\":" << track.alsaPort << ",";
 		out << "\"channel\":" << static_cast<int>(track.channel) << ",";
+		out << "\"offsetMs\":" << track.offsetMs << ",";
 		out << "\"items\":[";
 		for (size_t i = 0; i < track.items.size(); ++i) {
 			const auto& item = track.items[i];
@@ -398,6 +434,55 @@ bool loadFromFile(const std::string& path, Song& song) {
 	if (getString(obj, "midiDevice", midiDevice)) {
 		loaded.midiDevice = midiDevice;
 	}
+	JsonValue::Array tempoArray;
+	if (getArray(obj, "tempoEvents", tempoArray)) {
+		for (const auto& tempoValue : tempoArray) {
+			if (tempoValue.type != JsonValue::Type::Object) {
+				return false;
+			}
+			double tick = 0.0;
+			double bpm = 0.0;
+			if (!getNumber(tempoValue.object, "tick", tick)) {
+				return false;
+			}
+			if (!getNumber(tempoValue.object, "bpm", bpm)) {
+				return false;
+			}
+			TempoEvent tempo;
+			tempo.tick = static_cast<uint32_t>(tick);
+			tempo.bpm = bpm;
+			loaded.tempoEvents.push_back(tempo);
+		}
+	}
+	bool loopEnabled = false;
+	double loopStart = 0.0;
+	double loopEnd = 0.0;
+	if (getBool(obj, "loopEnabled", loopEnabled) && getNumber(obj, "loopStart", loopStart) &&
+		getNumber(obj, "loopEnd", loopEnd)) {
+		loaded.loopEnabled = loopEnabled;
+		loaded.loopStart = static_cast<uint32_t>(loopStart);
+		loaded.loopEnd = static_cast<uint32_t>(loopEnd);
+	}
+	JsonValue::Array portOffsetsArray;
+	if (getArray(obj, "portOffsets", portOffsetsArray)) {
+		for (const auto& portValue : portOffsetsArray) {
+			if (portValue.type != JsonValue::Type::Object) {
+				return false;
+			}
+			double client = -1;
+			double port = -1;
+			double offsetMs = 0.0;
+			if (!getNumber(portValue.object, "client", client) || !getNumber(portValue.object, "port", port) ||
+				!getNumber(portValue.object, "offsetMs", offsetMs)) {
+				return false;
+			}
+			PortOffset portOffset;
+			portOffset.client = static_cast<int>(client);
+			portOffset.port = static_cast<int>(port);
+			portOffset.offsetMs = offsetMs;
+			loaded.portOffsets.push_back(portOffset);
+		}
+	}
 	for (const auto& trackValue : tracksArray) {
 		if (trackValue.type != JsonValue::Type::Object) {
 			return false;
@@ -408,6 +493,7 @@ bool loadFromFile(const std::string& path, Song& song) {
 		double alsaClient = -1;
 		double alsaPort = -1;
 		double channel = 0;
+		double offsetMs = 0.0;
 		JsonValue::Array itemsArray;
 		if (!getString(trackObj, "name", name)) {
 			name = "Track";
@@ -421,6 +507,9 @@ bool loadFromFile(const std::string& path, Song& song) {
 		if (!getNumber(trackObj, "channel", channel)) {
 			channel = 0;
 		}
+		if (!getNumber(trackObj, "offsetMs", offsetMs)) {
+			offsetMs = 0.0;
+		}
 		if (!getArray(trackObj, "items", itemsArray)) {
 			return false;
 		}
@@ -428,6 +517,7 @@ bool loadFromFile(const std::string& path, Song& song) {
 		track.alsaClient = static_cast<int>(alsaClient);
 		track.alsaPort = static_cast<int>(alsaPort);
 		track.channel = static_cast<uint8_t>(channel);
+		track.offsetMs = offsetMs;
 		for (const auto& itemValue : itemsArray) {
 			if (itemValue.type != JsonValue::Type::Object) {
 				return false;
@@ -0,0 +1,73 @@
+#pragma once
+
+// Helpers shared by the sequencer tests: a failure counter, note and song builders,
+// and lookups into what an EventLogOutput recorded.
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "audio/EventLogOutput.h"
+#include "core/Types.h"
+
+namespace linearseq::test {
+
+inline int failures = 0;
+
+inline void check(bool condition, const char* what, long long detail = 0) {
+	if (!condition) {
+		std::printf("FAIL: %s (%lld)\n", what, detail);
+		++failures;
+	}
+}
+
+// Prints the outcome and returns the test's exit status.
+inline int finish(const char* name) {
+	if (failures > 0) {
+		std::printf("%d check(s) failed\n", failures);
+		return 1;
+	}
+	std::printf("%s: all checks passed\n", name);
+	return 0;
+}
+
+inline MidiEvent note(uint32_t tick, uint8_t pitch, uint32_t duration) {
+	MidiEvent event;
+	event.tick = tick;
+	event.data1 = pitch;
+	event.data2 = 100;
+	event.duration = duration;
+	return event;
+}
+
+// One track on channel 0 holding one item with the events.
+inline Song songOf(const std::vector<MidiEvent>& events) {
+	Song song;
+	Track track;
+	MidiItem item;
+	item.events = events;
+	track.items.push_back(item);
+	song.tracks.push_back(track);
+	return song;
+}
+
+// Logged messages with this status and first data byte (pitch or controller), in order.
+inline std::vector<EventLogOutput::Entry> entriesOf(const EventLogOutput& log, MidiStatus status, uint8_t data1) {
+	std::vector<EventLogOutput::Entry> found;
+	for (const auto& entry : log.entries()) {
+		if (entry.status == status && entry.data1 == data1) {
+			found.push_back(entry);
+		}
+	}
+	return found;
+}
+
+// Ticks of those messages.
+inline std::vector<uint64_t> ticksOf(const EventLogOutput& log, MidiStatus status, uint8_t data1) {
+	std::vector<uint64_t> ticks;
+	for (const auto& entry : entriesOf(log, status, data1)) {
+		ticks.push_back(entry.tick);
+	}
+	return ticks;
+}
+
+} // namespace linearseq::test
@@ -0,0 +1,106 @@
+// Memory and walk throughput of the playback stream, against the original layout
+// (64-bit tick, 16 bytes per event).
+// Usage: bench_event_layout [events]
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "core/PlaybackQueue.h"
+
+using namespace linearseq;
+
+namespace {
+
+constexpr int REPEATS = 5;
+constexpr uint64_t TICKS_PER_STEP = 1; // EveryTick clock: the loop runs on every tick
+
+struct LegacyEvent {
+	uint64_t absTick = 0;
+	MidiStatus status = MidiStatus::NoteOn;
+	uint8_t channel = 0;
+	uint8_t data1 = 0;
+	uint8_t data2 = 0;
+};
+
+Song songWith(uint64_t events) {
+	std::mt19937 rng(3);
+	Song song;
+	song.tracks.resize(16);
+	for (size_t t = 0; t < song.tracks.size(); ++t) {
+		song.tracks[t].channel = static_cast<uint8_t>(t);
+	}
+	const uint64_t notes = events / 2;
+	for (uint64_t i = 0; i < notes; ++i) {
+		auto& items = song.tracks[i % 16].items;
+		if (items.empty() || items.back().events.size() == 500) {
+			items.emplace_back();
+			items.back().startTick = static_cast<uint32_t>(i / 16 * 4);
+		}
+		MidiEvent event;
+		event.tick = static_cast<uint32_t>(items.back().events.size() * 4 + rng() % 4);
+		event.data1 = static_cast<uint8_t>(36 + rng() % 48);
+		event.data2 = 100;
+		event.duration = 2 + static_cast<uint32_t>(rng() % 200);
+		items.back().events.push_back(event);
+	}
+	return song;
+}
+
+// The dispatch loop's access pattern: every tick, consume the events due by then.
+template <typename Event>
+uint64_t walk(const std::vector<Event>& events) {
+	uint64_t checksum = 0;
+	size_t index = 0;
+	const uint64_t last = events.empty() ? 0 : events.back().absTick;
+	for (uint64_t tick = 0; tick <= last; tick += TICKS_PER_STEP) {
+		while (index < events.size() && events[index].absTick <= tick) {
+			const Event& event = events[index];
+			checksum += static_cast<uint8_t>(event.status) ^ event.channel ^ event.data1 ^ event.data2;
+			++index;
+		}
+	}
+	return checksum;
+}
+
+template <typename Fn>
+double bestMs(Fn&& run) {
+	double best = std::numeric_limits<double>::max();
+	for (int i = 0; i < REPEATS; ++i) {
+		const auto start = std::chrono::steady_clock::now();
+		run();
+		const auto elapsed = std::chrono::steady_clock::now() - start;
+		best = std::min(best, std::chrono::duration<double, std::milli>(elapsed).count());
+	}
+	return best;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+	const uint64_t size = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+	const std::vector<PlaybackEvent> events = PlaybackQueue::build(songWith(size));
+	std::vector<LegacyEvent> legacy;
+	legacy.reserve(events.size());
+	for (const auto& event : events) {
+		legacy.push_back({event.absTick, event.status, event.channel, event.data1, event.data2});
+	}
+
+	volatile uint64_t sink = 0;
+	const double legacyMs = bestMs([&] { sink = sink + walk(legacy); });
+	const double packedMs = bestMs([&] { sink = sink + walk(events); });
+	const auto mib = [](size_t bytes) { return static_cast<double>(bytes) / (1024.0 * 1024.0); };
+	const double count = static_cast<double>(events.size());
+
+	std::printf("%zu stream events over %llu ticks\n", events.size(),
+		static_cast<unsigned long long>(events.empty() ? 0 : events.back().absTick));
+	std::printf("legacy  %2zu B/event %8.2f MiB  walk %8.2f ms  %6.2f ns/event\n", sizeof(LegacyEvent),
+		mib(legacy.size() * sizeof(LegacyEvent)), legacyMs, legacyMs * 1.0e6 / count);
+	std::printf("current %2zu B/event %8.2f MiB  walk %8.2f ms  %6.2f ns/event\n", sizeof(PlaybackEvent),
+		mib(events.size() * sizeof(PlaybackEvent)), packedMs, packedMs * 1.0e6 / count);
+	return 0;
+}
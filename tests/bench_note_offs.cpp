@@ -0,0 +1,131 @@
+// Cost of note-off handling with many sustained notes.
+// Usage: bench_note_offs [notes]
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <vector>
+
+#include "audio/MidiOutput.h"
+#include "core/Sequencer.h"
+#include "core/VirtualClock.h"
+
+using namespace linearseq;
+
+namespace {
+
+class NullOutput : public MidiOutput {
+public:
+	uint64_t noteOffs = 0;
+
+	bool isOpen() const override { return true; }
+	bool sendNoteOn(uint8_t, uint8_t, uint8_t) override { return true; }
+	bool sendNoteOff(uint8_t, uint8_t, uint8_t) override { ++noteOffs; return true; }
+	bool sendControlChange(uint8_t, uint8_t, uint8_t) override { return true; }
+	bool sendProgramChange(uint8_t, uint8_t) override { return true; }
+	bool sendPitchBend(uint8_t, uint8_t, uint8_t) override { return true; }
+	void sendAllNotesOff() override {}
+};
+
+struct PendingNoteOff {
+	uint64_t tick = 0;
+	uint8_t channel = 0;
+	uint8_t note = 0;
+	uint8_t velocity = 0;
+};
+
+// The original scheme: a mutex-guarded vector scanned and erased from every tick.
+struct LockedVector {
+	std::mutex mutex;
+	std::vector<PendingNoteOff> pending;
+
+	void push(const PendingNoteOff& entry) {
+		std::lock_guard<std::mutex> lock(mutex);
+		pending.push_back(entry);
+	}
+
+	void process(uint64_t tick, NullOutput& output) {
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = pending.begin();
+		while (it != pending.end()) {
+			if (it->tick <= tick) {
+				output.sendNoteOff(it->channel, it->note, it->velocity);
+				it = pending.erase(it);
+			} else {
+				++it;
+			}
+		}
+	}
+};
+
+// Note i starts at tick i and lasts `notes` ticks, so all of them overlap at the peak.
+// Durations are staggered so note-offs are pushed out of order.
+uint64_t durationOf(uint64_t i, uint64_t notes) {
+	return notes + (i * 7919) % notes;
+}
+
+template <typename Fn>
+double msFor(Fn&& run) {
+	const auto start = std::chrono::steady_clock::now();
+	run();
+	const auto elapsed = std::chrono::steady_clock::now() - start;
+	return std::chrono::duration<double, std::milli>(elapsed).count();
+}
+
+Song overlappingSong(uint64_t notes) {
+	Song song;
+	Track track;
+	MidiItem item;
+	for (uint64_t i = 0; i < notes; ++i) {
+		MidiEvent event;
+		event.tick = static_cast<uint32_t>(i);
+		event.data1 = static_cast<uint8_t>(i % 128);
+		event.data2 = 100;
+		event.duration = static_cast<uint32_t>(durationOf(i, notes));
+		item.events.push_back(event);
+	}
+	item.lengthTicks = static_cast<uint32_t>(3 * notes);
+	track.items.push_back(item);
+	song.tracks.push_back(track);
+	return song;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+	const uint64_t notes = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10000;
+	const uint64_t endTick = 3 * notes;
+
+	// Same schedule through both structures: one note-on per tick, then drain.
+	NullOutput vectorOutput;
+	LockedVector vector;
+	const double vectorMs = msFor([&] {
+		for (uint64_t tick = 0; tick <= endTick; ++tick) {
+			vector.process(tick, vectorOutput);
+			if (tick < notes) {
+				vector.push({tick + durationOf(tick, notes), 0, static_cast<uint8_t>(tick % 128), 0});
+			}
+		}
+	});
+
+	std::printf("%llu overlapping notes, %llu ticks\n",
+		static_cast<unsigned long long>(notes), static_cast<unsigned long long>(endTick + 1));
+	std::printf("locked vector  %9.2f ms  %8.1f ns/tick\n", vectorMs, vectorMs * 1.0e6 / static_cast<double>(endTick + 1));
+
+	// Whole sequencer tick path over the same song: note-offs are explicit events in the
+	// playback queue, so each tick is a cursor walk.
+	NullOutput output;
+	VirtualClock clock;
+	Sequencer sequencer;
+	sequencer.setSong(overlappingSong(notes));
+	sequencer.setOutput(&output);
+	sequencer.setTickSource(&clock);
+	sequencer.play(0);
+	const double sequencerMs = msFor([&] { clock.run(endTick); });
+	sequencer.stop();
+	std::printf("sequencer      %9.2f ms  %8.1f ns/tick\n", sequencerMs, sequencerMs * 1.0e6 / static_cast<double>(endTick + 1));
+
+	const bool complete = vectorOutput.noteOffs == notes && output.noteOffs == notes;
+	return complete ? 0 : 1;
+}
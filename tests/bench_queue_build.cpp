@@ -0,0 +1,174 @@
+// Playback queue build: one global sort versus per-item runs merged with a heap.
+// Usage: bench_queue_build [events...]   (default: 10000 100000 1000000)
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "core/PlaybackQueue.h"
+
+using namespace linearseq;
+
+namespace {
+
+constexpr uint32_t EVENTS_PER_ITEM = 500;
+constexpr int TRACKS = 16;
+constexpr int REPEATS = 5;
+
+// Items of EVENTS_PER_ITEM mostly ascending notes spread over the tracks.
+Song songWith(uint64_t events) {
+	std::mt19937 rng(7);
+	Song song;
+	song.tracks.resize(TRACKS);
+	for (int t = 0; t < TRACKS; ++t) {
+		song.tracks[t].channel = static_cast<uint8_t>(t);
+	}
+	const uint64_t items = std::max<uint64_t>(1, events / EVENTS_PER_ITEM);
+	for (uint64_t i = 0; i < items; ++i) {
+		MidiItem item;
+		item.startTick = static_cast<uint32_t>((i / TRACKS) * 8 * 480);
+		for (uint32_t e = 0; e < EVENTS_PER_ITEM; ++e) {
+			MidiEvent event;
+			event.tick = e * 8 + static_cast<uint32_t>(rng() % 4);
+			event.data1 = static_cast<uint8_t>(36 + rng() % 48);
+			event.data2 = 100;
+			event.duration = 20 + static_cast<uint32_t>(rng() % 400);
+			item.events.push_back(event);
+		}
+		item.lengthTicks = EVENTS_PER_ITEM * 8;
+		song.tracks[i % TRACKS].items.push_back(item);
+	}
+	return song;
+}
+
+// The previous builder: every event of every item into one vector, one global sort,
+// then the same overlap resolution.
+std::vector<PlaybackEvent> globalSortBuild(const Song& song) {
+	constexpr uint32_t none = std::numeric_limits<uint32_t>::max();
+	struct Entry {
+		PlaybackEvent event;
+		uint32_t voice;
+		uint32_t order;
+	};
+	std::vector<Entry> entries;
+	uint32_t voices = 0;
+	for (size_t index = 0; index < song.tracks.size(); ++index) {
+		const Track& track = song.tracks[index];
+		for (const auto& item : track.items) {
+			for (const auto& event : item.events) {
+				Entry entry{{item.startTick + event.tick, event.status, track.channel,
+					event.data1, event.data2, static_cast<uint16_t>(index)}, none,
+					static_cast<uint32_t>(entries.size())};
+				const bool on = event.status == MidiStatus::NoteOn && event.data2 > 0;
+				if (on) {
+					entry.voice = voices++;
+				}
+				entries.push_back(entry);
+				if (on && event.duration > 0) {
+					entry.event.absTick += event.duration;
+					entry.event.status = MidiStatus::NoteOff;
+					entry.event.data2 = 0;
+					entry.order = static_cast<uint32_t>(entries.size());
+					entries.push_back(entry);
+				}
+			}
+		}
+	}
+	std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+		if (a.event.absTick != b.event.absTick) {
+			return a.event.absTick < b.event.absTick;
+		}
+		const bool offA = PlaybackQueue::isNoteOff(a.event);
+		const bool offB = PlaybackQueue::isNoteOff(b.event);
+		return offA != offB ? offA : a.order < b.order;
+	});
+	// Overlaps are resolved per track.
+	std::vector<uint32_t> owner(VOICE_SLOTS * song.tracks.size(), none);
+	std::vector<PlaybackEvent> queue;
+	queue.reserve(entries.size());
+	for (const auto& entry : entries) {
+		const PlaybackEvent& event = entry.event;
+		uint32_t& current = owner[voiceSlot(event.channel, event.data1) * song.tracks.size() + event.track];
+		if (PlaybackQueue::isNoteOff(event)) {
+			if (entry.voice == none || entry.voice == current) {
+				current = none;
+				queue.push_back(event);
+			}
+			continue;
+		}
+		if (current != none) {
+			PlaybackEvent off = event;
+			off.status = MidiStatus::NoteOff;
+			off.data2 = 0;
+			queue.push_back(off);
+		}
+		current = entry.voice;
+		queue.push_back(event);
+	}
+	return queue;
+}
+
+// Best of REPEATS, in milliseconds.
+template <typename Fn>
+double bestMs(Fn&& run) {
+	double best = std::numeric_limits<double>::max();
+	for (int i = 0; i < REPEATS; ++i) {
+		const auto start = std::chrono::steady_clock::now();
+		run();
+		const auto elapsed = std::chrono::steady_clock::now() - start;
+		best = std::min(best, std::chrono::duration<double, std::milli>(elapsed).count());
+	}
+	return best;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+	std::vector<uint64_t> sizes;
+	for (int i = 1; i < argc; ++i) {
+		sizes.push_back(std::strtoull(argv[i], nullptr, 10));
+	}
+	if (sizes.empty()) {
+		sizes = {10000, 100000, 1000000};
+	}
+
+	bool consistent = true;
+	for (const uint64_t size : sizes) {
+		const Song song = songWith(size);
+		std::vector<PlaybackEvent> reference;
+		std::vector<PlaybackEvent> merged;
+
+		const double globalMs = bestMs([&] { reference = globalSortBuild(song); });
+		const double serialMs = bestMs([&] {
+			PlaybackQueueBuilder builder;
+			builder.setMaxThreads(1);
+			merged = builder.build(song);
+		});
+		const double parallelMs = bestMs([&] {
+			PlaybackQueueBuilder builder;
+			merged = builder.build(song);
+		});
+		PlaybackQueueBuilder parallel;
+		parallel.build(song);
+		// One item edited: only its run is re-sorted.
+		Song edited = song;
+		const double editMs = bestMs([&] {
+			++edited.tracks[0].items[0].events[0].tick;
+			merged = parallel.build(edited);
+		});
+		consistent = consistent && merged.size() == parallel.lastStats().events;
+		consistent = consistent && parallel.build(song).size() == reference.size();
+
+		std::printf("%8llu source events, %8zu stream events\n",
+			static_cast<unsigned long long>(size), reference.size());
+		std::printf("  global sort          %9.2f ms\n", globalMs);
+		std::printf("  runs + merge, 1 thr  %9.2f ms\n", serialMs);
+		std::printf("  runs + merge, %zu thr  %9.2f ms\n", parallel.maxThreads(), parallelMs);
+		std::printf("  one item edited      %9.2f ms\n", editMs);
+	}
+	return consistent ? 0 : 1;
+}
@@ -0,0 +1,105 @@
+// Per-tick cost of the clock -> sequencer dispatch.
+// Usage: bench_tick_dispatch [ticks]
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+#include "audio/MidiOutput.h"
+#include "core/Sequencer.h"
+#include "core/VirtualClock.h"
+
+using namespace linearseq;
+
+namespace {
+
+// Minimal consumer: enough work that the call cannot be optimized away.
+struct Consumer {
+	uint64_t sum = 0;
+	void onTick(uint64_t tick) { sum += tick; }
+	uint64_t nextTick(uint64_t tick) { return tick + 1; }
+};
+
+// Accepts everything, costs nothing, so the sequencer's own path is measured.
+class NullOutput : public MidiOutput {
+public:
+	bool isOpen() const override { return true; }
+	bool sendNoteOn(uint8_t, uint8_t, uint8_t) override { return true; }
+	bool sendNoteOff(uint8_t, uint8_t, uint8_t) override { return true; }
+	bool sendControlChange(uint8_t, uint8_t, uint8_t) override { return true; }
+	bool sendProgramChange(uint8_t, uint8_t) override { return true; }
+	bool sendPitchBend(uint8_t, uint8_t, uint8_t) override { return true; }
+	void sendAllNotesOff() override {}
+	bool sendRealtime(MidiStatus) override { return true; }
+};
+
+template <typename Fn>
+double nsPerTick(uint64_t ticks, Fn&& run) {
+	const auto start = std::chrono::steady_clock::now();
+	run();
+	const auto elapsed = std::chrono::steady_clock::now() - start;
+	return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()) /
+		static_cast<double>(ticks);
+}
+
+// One note per tick on a single track.
+Song denseSong(uint64_t ticks) {
+	Song song;
+	Track track;
+	MidiItem item;
+	item.lengthTicks = static_cast<uint32_t>(ticks);
+	for (uint64_t tick = 0; tick < ticks; ++tick) {
+		MidiEvent event;
+		event.tick = static_cast<uint32_t>(tick);
+		event.data1 = static_cast<uint8_t>(36 + tick % 48);
+		event.data2 = 100;
+		event.duration = 1;
+		item.events.push_back(event);
+	}
+	track.items.push_back(item);
+	song.tracks.push_back(track);
+	return song;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+	const uint64_t ticks = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 20000000;
+
+	Consumer consumer;
+	VirtualClock clock;
+
+	// Before: std::function callbacks (what Clock used to call every tick).
+	clock.setTickCallback([&consumer](uint64_t tick) { consumer.onTick(tick); });
+	clock.setNextTickQuery([&consumer](uint64_t tick) { return consumer.nextTick(tick); });
+	clock.start(0);
+	const double functionNs = nsPerTick(ticks, [&] { clock.run(ticks - 1); });
+	clock.stop();
+
+	// After: function-pointer sink bound at compile time.
+	clock.setTickSink(TickSink::bind<Consumer, &Consumer::onTick, &Consumer::nextTick>(&consumer));
+	clock.start(0);
+	const double sinkNs = nsPerTick(ticks, [&] { clock.run(ticks - 1); });
+	clock.stop();
+
+	std::printf("dispatch  std::function  %6.2f ns/tick\n", functionNs);
+	std::printf("dispatch  TickSink       %6.2f ns/tick\n", sinkNs);
+
+	// Whole sequencer tick path (note on + note off every tick), clock output off and on.
+	const uint64_t songTicks = std::min<uint64_t>(ticks, 2000000);
+	NullOutput output;
+	VirtualClock songClock;
+	Sequencer sequencer;
+	sequencer.setSong(denseSong(songTicks));
+	sequencer.setOutput(&output);
+	sequencer.setTickSource(&songClock);
+	for (const bool clockOut : {false, true}) {
+		sequencer.setSendMidiClock(clockOut);
+		sequencer.play(0);
+		const double sequencerNs = nsPerTick(songTicks, [&] { songClock.run(songTicks); });
+		sequencer.stop();
+		std::printf("sequencer clock-out %-3s  %6.2f ns/tick\n", clockOut ? "on" : "off", sequencerNs);
+	}
+	return consumer.sum == 0 ? 1 : 0;
+}
@@ -0,0 +1,152 @@
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <vector>
+
+#include "core/MidiClockSync.h"
+#include "core/TempoMap.h"
+
+using linearseq::MidiClockSync;
+using linearseq::TempoEvent;
+using linearseq::TempoMap;
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const char* what, unsigned long long detail = 0) {
+	if (!condition) {
+		std::printf("FAIL: %s (%llu)\n", what, detail);
+		++failures;
+	}
+}
+
+// Ten hours at 120 BPM / 960 PPQN: every tick deadline stays within 1 ns of the
+// exact rational time, with no growth over the session.
+void testConstantTempoDoesNotDrift() {
+	const TempoMap map(120.0, 960);
+	const uint64_t ticksPerHour = 120ULL * 960ULL * 60ULL;
+	const uint64_t endTick = ticksPerHour * 10;
+	// Exact period: 60e9 / (120 * 960) = 520833 + 1/3 ns.
+	for (uint64_t tick = 0; tick <= endTick; tick += 997) {
+		const int64_t expected = static_cast<int64_t>(tick * 520833ULL + tick / 3);
+		if (map.tickToNs(tick) != expected) {
+			check(false, "constant tempo tick time", tick);
+			return;
+		}
+	}
+	check(map.tickToNs(endTick) == 36000LL * 1000000000LL, "10 h ends exactly at 36000 s");
+}
+
+// Odd tempos do not divide evenly into nanoseconds; the error against a long double
+// reference must stay below 1 ns at the end of a long session.
+void testOddTempoErrorIsBounded() {
+	const uint32_t ppqn = 96;
+	const TempoMap map(133.7, ppqn);
+	const long double period = 60.0e9L / (133.7L * ppqn);
+	const uint64_t endTick = static_cast<uint64_t>(12.0 * 3600.0e9 / static_cast<double>(period));
+	for (uint64_t tick = endTick - 100000; tick <= endTick; ++tick) {
+		const long double exact = static_cast<long double>(tick) * period;
+		// tickToNs floors, so it may sit up to 1 ns before the exact time, never after.
+		const long double error = exact - static_cast<long double>(map.tickToNs(tick));
+		if (error < -1.0e-3L || error >= 1.0L + 1.0e-3L) {
+			check(false, "odd tempo error >= 1 ns", tick);
+			return;
+		}
+	}
+}
+
+// Per-tick periods only differ by the 1 ns floor, so a clock stepping tick to tick
+// from the map never accumulates rounding.
+void testStepsSumToPosition() {
+	const TempoMap map(127.0, 480);
+	int64_t position = 0;
+	for (uint64_t tick = 1; tick <= 5000000; ++tick) {
+		const int64_t step = map.tickToNs(tick) - map.tickToNs(tick - 1);
+		position += step;
+		const int64_t nominal = static_cast<int64_t>(map.nsPerTickAt(tick));
+		if (step < nominal || step > nominal + 1) {
+			check(false, "tick step outside floor/ceil of the period", tick);
+			return;
+		}
+	}
+	check(position == map.tickToNs(5000000), "summed steps equal direct position");
+}
+
+// Tempo changes start exactly where the previous segment ended, and nsToTick inverts
+// tickToNs across segments.
+void testTempoChangesAndInverse() {
+	const std::vector<TempoEvent> changes = {{1920, 90.0}, {7680, 171.3}, {20000, 60.0}};
+	const TempoMap map(120.0, 480, changes);
+	check(map.segments().size() == 4, "four segments");
+	for (size_t i = 1; i < map.segments().size(); ++i) {
+		const auto& segment = map.segments()[i];
+		const auto& previous = map.segments()[i - 1];
+		const long double period = 60.0e9L / (static_cast<long double>(previous.bpm) * map.ppqn());
+		const long double exact = static_cast<long double>(previous.startNs) +
+			static_cast<long double>(segment.startTick - previous.startTick) * period;
+		check(std::fabs(static_cast<long double>(segment.startNs) - exact) < 1.0L, "segment start continuity", i);
+	}
+	for (uint64_t tick = 1; tick < 40000; ++tick) {
+		const int64_t ns = map.tickToNs(tick);
+		if (map.nsToTick(ns) != tick || map.nsToTick(ns - 1) != tick - 1) {
+			check(false, "nsToTick inverts tickToNs", tick);
+			return;
+		}
+	}
+}
+
+// The clock rebases its anchor whenever the tempo map is replaced. Rebasing onto an
+// identical map thousands of times must not move any later deadline.
+void testRebaseIsLossless() {
+	const TempoMap map(133.7, 960);
+	const int64_t startNs = 123456789;
+	int64_t anchorNs = startNs;
+	uint64_t anchorTick = 0;
+	for (uint64_t rebaseTick = 7; rebaseTick < 7000000; rebaseTick += 7001) {
+		anchorNs += map.tickToNs(rebaseTick) - map.tickToNs(anchorTick);
+		anchorTick = rebaseTick;
+	}
+	const uint64_t tick = 9000000;
+	const int64_t rebased = anchorNs + (map.tickToNs(tick) - map.tickToNs(anchorTick));
+	check(rebased == startNs + map.tickToNs(tick), "rebased deadline equals direct deadline");
+}
+
+} // namespace
+
+// Deadlines from the published loop estimate: steady 120 BPM input predicts the next
+// pulse one period on, and nothing is due once the transport stops.
+void testMidiClockDeadlines() {
+	constexpr int64_t PERIOD_NS = 20833333; // 120 BPM
+	MidiClockSync sync;
+	sync.locate(0);
+	sync.setTransportRunning(true);
+	int64_t arrival = 1000000000;
+	for (int pulse = 0; pulse < 96; ++pulse) {
+		sync.pulse(arrival);
+		arrival += PERIOD_NS;
+	}
+	const int64_t expected = arrival; // Song pulse 96 is due where the next one arrives
+	const int64_t deadline = sync.deadlineNs(96.0);
+	check(std::llabs(deadline - expected) < 1000, "next pulse predicted", std::llabs(deadline - expected));
+	check(sync.deadlineNs(99.0) == std::numeric_limits<int64_t>::max(), "no deadline past the next pulses");
+	sync.setTransportRunning(false);
+	check(sync.deadlineNs(96.0) == std::numeric_limits<int64_t>::max(), "no deadline while stopped");
+}
+
+int main() {
+	testConstantTempoDoesNotDrift();
+	testOddTempoErrorIsBounded();
+	testStepsSumToPosition();
+	testTempoChangesAndInverse();
+	testRebaseIsLossless();
+	testMidiClockDeadlines();
+	if (failures > 0) {
+		std::printf("%d check(s) failed\n", failures);
+		return 1;
+	}
+	std::printf("test_clock: all checks passed\n");
+	return 0;
+}
@@ -0,0 +1,510 @@
+#include <cstdint>
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "audio/EventLogOutput.h"
+#include "core/Sequencer.h"
+#include "core/VirtualClock.h"
+#include "TestSupport.h"
+
+using namespace linearseq;
+using namespace linearseq::test;
+
+namespace {
+
+// Replacing the song mid-note: removed notes stop at the edit, surviving notes end
+// exactly once on their (possibly edited) off, and new notes play from the edit on.
+void testEditWhilePlaying() {
+	VirtualClock clock;
+	EventLogOutput log(clock);
+	Sequencer sequencer;
+	sequencer.setTickSource(&clock);
+	sequencer.setOutput(&log);
+	sequencer.setSong(songOf({note(0, 60, 1000), note(0, 64, 1000), note(0, 67, 1000)}));
+	sequencer.play(0);
+	clock.advanceTo(500);
+
+	// 60 removed, 64 kept, 67 shortened, 72 added ahead of the position.
+	sequencer.setSong(songOf({note(0, 64, 1000), note(0, 67, 800), note(600, 72, 100), note(100, 74, 50)}));
+	clock.run(2000);
+	sequencer.stop();
+
+	const auto off60 = ticksOf(log, MidiStatus::NoteOff, 60);
+	check(off60.size() == 1 && off60[0] == 500, "removed note released at the edit");
+	const auto off64 = ticksOf(log, MidiStatus::NoteOff, 64);
+	check(off64.size() == 1 && off64[0] == 1000, "kept note released once, on time");
+	const auto off67 = ticksOf(log, MidiStatus::NoteOff, 67);
+	check(off67.size() == 1 && off67[0] == 800, "shortened note follows the edit");
+	const auto on72 = ticksOf(log, MidiStatus::NoteOn, 72);
+	const auto off72 = ticksOf(log, MidiStatus::NoteOff, 72);
+	check(on72.size() == 1 && on72[0] == 600 && off72.size() == 1 && off72[0] == 700, "added note plays");
+	check(ticksOf(log, MidiStatus::NoteOn, 74).empty(), "notes added behind the position are not played late");
+	check(ticksOf(log, MidiStatus::NoteOn, 64).size() == 1, "kept note is not re-struck");
+}
+
+// Repeated edits between ticks: only the latest is adopted, earlier ones are freed.
+void testRepeatedEdits() {
+	VirtualClock clock;
+	EventLogOutput log(clock);
+	Sequencer sequencer;
+	sequencer.setTickSource(&clock);
+	sequencer.setOutput(&log);
+	sequencer.setSong(songOf({note(0, 60, 400)}));
+	sequencer.play(0);
+	for (uint64_t tick = 10; tick < 300; tick += 10) {
+		clock.advanceTo(tick);
+		sequencer.setSong(songOf({note(0, 60, 400), note(static_cast<uint32_t>(tick + 5), 61, 1)}));
+		sequencer.setSong(songOf({note(0, 60, 400), note(static_cast<uint32_t>(tick + 5), 62, 1)}));
+	}
+	clock.run(1000);
+	sequencer.stop();
+
+	check(ticksOf(log, MidiStatus::NoteOn, 61).empty(), "superseded edits are never played");
+	check(ticksOf(log, MidiStatus::NoteOn, 62).size() == 29, "latest edit of each step plays",
+		ticksOf(log, MidiStatus::NoteOn, 62).size());
+	const auto off60 = ticksOf(log, MidiStatus::NoteOff, 60);
+	check(off60.size() == 1 && off60[0] == 400, "unchanged note survives every swap");
+}
+
+// Mute and solo while playing: notes on a silenced track stop at once, its later notes
+// are skipped, and it is heard again from the next note after being re-enabled.
+void testLiveMuteSolo() {
+	VirtualClock clock;
+	EventLogOutput log(clock);
+	Sequencer sequencer;
+	sequencer.setTickSource(&clock);
+	sequencer.setOutput(&log);
+	Song song = songOf({note(0, 60, 1000)});
+	song.tracks.push_back(songOf({note(0, 64, 1000), note(400, 65, 100), note(800, 66, 100)}).tracks[0]);
+	sequencer.setSong(song);
+	sequencer.play(0);
+	clock.advanceTo(300);
+	sequencer.setTrackMute(1, true);
+	clock.advanceTo(700);
+	sequencer.setTrackMute(1, false);
+	clock.run(2000);
+	sequencer.stop();
+
+	const auto off64 = ticksOf(log, MidiStatus::NoteOff, 64);
+	check(off64.size() == 1 && off64[0] == 300, "sounding note released when its track is muted");
+	check(ticksOf(log, MidiStatus::NoteOn, 65).empty(), "muted track's notes are skipped");
+	check(ticksOf(log, MidiStatus::NoteOn, 66).size() == 1, "unmuted track plays again");
+	const auto off60 = ticksOf(log, MidiStatus::NoteOff, 60);
+	check(off60.size() == 1 && off60[0] == 1000, "other track unaffected");
+	check(sequencer.song().tracks[1].mute == false, "mute state kept in the song");
+
+	log.clear();
+	sequencer.play(0);
+	clock.advanceTo(100);
+	sequencer.setTrackSolo(1, true);
+	clock.run(2000);
+	sequencer.stop();
+	const auto soloOff60 = ticksOf(log, MidiStatus::NoteOff, 60);
+	check(soloOff60.size() == 1 && soloOff60[0] == 100, "solo releases the other track's notes");
+	check(ticksOf(log, MidiStatus::NoteOn, 65).size() == 1, "soloed track keeps playing");
+}
+
+// A muted track's note on the same channel and pitch as an audible one neither cuts it
+// nor ends it; once heard, it retriggers the pitch like an overlap within a track.
+void testMutedDuplicateNote() {
+	for (const bool muted : {true, false}) {
+		VirtualClock clock;
+		EventLogOutput log(clock);
+		Sequencer sequencer;
+		sequencer.setTickSource(&clock);
+		sequencer.setOutput(&log);
+		Song song = songOf({note(0, 60, 1000)});
+		song.tracks.push_back(songOf({note(200, 60, 300)}).tracks[0]);
+		song.tracks[1].mute = muted;
+		sequencer.setSong(song);
+		sequencer.play(0);
+		clock.run(2000);
+		sequencer.stop();
+
+		const auto on60 = ticksOf(log, MidiStatus::NoteOn, 60);
+		const auto off60 = ticksOf(log, MidiStatus::NoteOff, 60);
+		if (muted) {
+			check(on60.size() == 1 && on60[0] == 0, "muted duplicate is not played");
+			check(off60.size() == 1 && off60[0] == 1000, "audible note ends on its own off");
+		} else {
+			check(on60.size() == 2 && on60[1] == 200, "heard duplicate retriggers");
+			check(off60.size() == 2 && off60[0] == 200 && off60[1] == 500, "retrigger off, then the duplicate's");
+		}
+	}
+}
+
+// Starting mid-song sends the controller, program and bend state set up before the
+// start, ahead of the first note, and nothing from before the start is played.
+void testPlayChasesState() {
+	VirtualClock clock;
+	EventLogOutput log(clock);
+	Sequencer sequencer;
+	sequencer.setTickSource(&clock);
+	sequencer.setOutput(&log);
+	MidiEvent program = note(0, 12, 0);
+	program.status = MidiStatus::ProgramChange;
+	MidiEvent volume = note(100, 7, 0);
+	volume.status = MidiStatus::ControlChange;
+	volume.data2 = 64;
+	MidiEvent bend = note(20000, 0, 0);
+	bend.status = MidiStatus::PitchBend;
+	bend.data2 = 0x50;
+	sequencer.setSong(songOf({program, volume, bend, note(0, 60, 10), note(30000, 62, 10)}));
+	sequencer.play(25000);
+	clock.run(40000);
+	sequencer.stop();
+
+	const auto entries = log.entries();
+	check(entries.size() >= 4, "chased state and the note were sent", entries.size());
+	if (entries.size() < 4) {
+		return;
+	}
+	check(entries[0].status == MidiStatus::ProgramChange && entries[0].data1 == 12, "program first");
+	check(entries[1].status == MidiStatus::ControlChange && entries[1].data1 == 7 && entries[1].data2 == 64,
+		"then controllers");
+	check(entries[2].status == MidiStatus::PitchBend && entries[2].data2 == 0x50, "then pitch bend");
+	check(entries[3].status == MidiStatus::NoteOn && entries[3].data1 == 62 && entries[3].tick == 30000,
+		"then the first note after the start");
+	check(ticksOf(log, MidiStatus::NoteOn, 60).empty(), "notes before the start are skipped");
+}
+
+// Seeking back to before a controller or bend was set puts it back to its default,
+// rather than leaving the value from the previous position on the output.
+void testSeekResetsUnsetState() {
+	VirtualClock clock;
+	EventLogOutput log(clock);
+	Sequencer sequencer;
+	sequencer.setTickSource(&clock);
+	sequencer.setOutput(&log);
+	MidiEvent volume = note(100, 7, 0);
+	volume.status = MidiStatus::ControlChange;
+	volume.data2 = 64;
+	MidiEvent bend = note(200, 0, 0);
+	bend.status = MidiStatus::PitchBend;
+	bend.data2 = 0x50;
+	sequencer.setSong(songOf({volume, bend, note(1000, 60, 10)}));
+	sequencer.play(0);
+	clock.advanceTo(500);
+	log.clear();
+	sequencer.seek(50);
+	clock.advanceTo(60);
+	sequencer.stop();
+
+	bool volumeReset = false;
+	bool bendCentered = false;
+	for (const auto& entry : log.entries()) {
+		volumeReset = volumeReset ||
+			(entry.status == MidiStatus::ControlChange && entry.data1 == 7 && entry.data2 == 100);
+		bendCentered = bendCentered ||
+			(entry.status == MidiStatus::PitchBend && entry.data1 == 0 && entry.data2 == 0x40);
+	}
+	check(volumeReset, "volume set after the new position goes back to its default");
+	check(bendCentered, "bend set after the new position is centered");
+
+	// Nothing was set before the stop position: playing from the start sends no state.
+	log.clear();
+	sequencer.play(0);
+	clock.advanceTo(10);
+	sequencer.stop();
+	bool resent = false;
+	for (const auto& entry : log.entries()) {
+		resent = resent || entry.status == MidiStatus::PitchBend ||
+			(entry.status == MidiStatus::ControlChange && entry.data1 == 7);
+	}
+	check(!resent, "no reset when nothing was set");
+}
+
+// Pause silences the sounding note and holds the position; resume picks up there
+// without replaying anything, re-striking or dropping the held note per policy, and
+// plays edits made while paused.
+void testPauseResume() {
+	for (const auto policy : {Sequencer::ResumePolicy::Retrigger, Sequencer::ResumePolicy::Drop}) {
+		const bool retrigger = policy == Sequencer::ResumePolicy::Retrigger;
+		VirtualClock clock;
+		EventLogOutput log(clock);
+		Sequencer sequencer;
+		sequencer.setTickSource(&clock);
+		sequencer.setOutput(&log);
+		sequencer.setResumePolicy(policy);
+		sequencer.setSong(songOf({note(0, 60, 1000), note(200, 62, 100), note(600, 64, 100)}));
+		sequencer.play(0);
+		clock.advanceTo(500);
+		sequencer.pause();
+		check(sequencer.isPaused() && !sequencer.isPlaying(), "paused");
+		check(sequencer.currentTick() == 500, "position held", sequencer.currentTick());
+		clock.run(5000);
+		check(log.entries().back().status == MidiStatus::NoteOff && log.entries().back().data1 == 60,
+			"sounding note silenced");
+
+		sequencer.setSong(songOf({note(0, 60, 1000), note(200, 62, 100), note(700, 66, 100)}));
+		sequencer.resume();
+		check(sequencer.isPlaying() && !sequencer.isPaused(), "resumed");
+		clock.run(3000);
+		sequencer.stop();
+
+		const auto on60 = ticksOf(log, MidiStatus::NoteOn, 60);
+		const auto off60 = ticksOf(log, MidiStatus::NoteOff, 60);
+		if (retrigger) {
+			check(on60.size() == 2 && on60[1] == 500, "held note re-struck on resume", on60.size());
+			check(off60.size() == 2 && off60[0] == 500 && off60[1] == 1000, "re-struck note ends on time");
+		} else {
+			check(on60.size() == 1, "held note dropped on resume", on60.size());
+			check(off60.size() == 1 && off60[0] == 500, "dropped note's off is skipped", off60.size());
+		}
+		check(ticksOf(log, MidiStatus::NoteOn, 62).size() == 1, "nothing before the pause is replayed");
+		check(ticksOf(log, MidiStatus::NoteOn, 64).empty(), "note removed while paused is not played");
+		const auto on66 = ticksOf(log, MidiStatus::NoteOn, 66);
+		check(on66.size() == 1 && on66[0] == 700, "note added while paused plays");
+	}
+}
+
+// Events falling due while the clock is held up: Burst plays them all, DropNotes skips
+// late note-ons (and their offs) but keeps controllers and the offs of sounding notes.
+void testLatePolicy() {
+	for (const auto policy : {Sequencer::LatePolicy::Burst, Sequencer::LatePolicy::DropNotes}) {
+		const bool drop = policy == Sequencer::LatePolicy::DropNotes;
+		VirtualClock clock;
+		EventLogOutput log(clock);
+		Sequencer sequencer;
+		sequencer.setTickSource(&clock);
+		sequencer.setOutput(&log);
+		sequencer.setLatePolicy(policy);
+		sequencer.setLateThresholdMs(10);
+		MidiEvent volume = note(150, 7, 0);
+		volume.status = MidiStatus::ControlChange;
+		sequencer.setSong(songOf({note(0, 60, 200), note(100, 62, 100), volume, note(300, 64, 10)}));
+		sequencer.resetClockStats();
+		sequencer.play(0);
+		clock.advanceTo(99);
+		clock.setTickLateness(50000000);
+		clock.advanceTo(250);
+		clock.setTickLateness(5000000); // Within the threshold
+		clock.run(1000);
+		sequencer.stop();
+
+		const ClockStats& stats = sequencer.clockStats();
+		check(stats.lateEvents.load() == 4, "late events counted", stats.lateEvents.load());
+		check(stats.droppedNotes.load() == (drop ? 1u : 0u), "late note-ons dropped per policy",
+			stats.droppedNotes.load());
+		check(ticksOf(log, MidiStatus::NoteOn, 62).size() == (drop ? 0u : 1u), "late note-on per policy");
+		check(ticksOf(log, MidiStatus::NoteOff, 62).size() == (drop ? 0u : 1u), "its off follows it");
+		check(ticksOf(log, MidiStatus::ControlChange, 7).size() == 1, "late controller still sent");
+		check(ticksOf(log, MidiStatus::NoteOff, 60).size() == 1, "late off of a sounding note still sent");
+		check(ticksOf(log, MidiStatus::NoteOn, 64).size() == 1, "on-time notes play");
+	}
+}
+
+// Tracks with an output address play on their own destination, offs included; chase
+// state goes to every destination in use.
+void testTrackRouting() {
+	VirtualClock clock;
+	EventLogOutput log(clock);
+	Sequencer sequencer;
+	sequencer.setTickSource(&clock);
+	sequencer.setOutput(&log);
+	MidiEvent volume = note(0, 7, 0);
+	volume.status = MidiStatus::ControlChange;
+	Song song = songOf({volume, note(100, 60, 50)});
+	for (const int client : {20, 21, 20}) {
+		Track track;
+		track.channel = static_cast<uint8_t>(song.tracks.size());
+		track.alsaClient = client;
+		track.alsaPort = 0;
+		MidiItem item;
+		item.events = {note(100, static_cast<uint8_t>(60 + song.tracks.size()), 50)};
+		track.items.push_back(item);
+		song.tracks.push_back(track);
+	}
+	sequencer.setSong(song);
+	sequencer.play(50);
+	clock.run(1000);
+	sequencer.stop();
+
+	const uint16_t expected[] = {0, 1, 2, 1}; // By pitch 60..63
+	size_t notes = 0;
+	size_t chased = 0;
+	for (const auto& entry : log.entries()) {
+		if ((entry.status == MidiStatus::NoteOn || entry.status == MidiStatus::NoteOff) && entry.data1 >= 60 &&
+			entry.data1 <= 63) {
+			check(entry.destination == expected[entry.data1 - 60], "note on its track's destination", entry.data1);
+			++notes;
+		} else if (entry.status == MidiStatus::ControlChange && entry.data1 == 7) {
+			++chased;
+		}
+	}
+	check(notes == 8, "every note played and released", notes);
+	check(chased == 3, "chase state sent to each destination", chased);
+}
+
+// A note's off goes where the note went, even if an edit moved its track to another
+// port or another position while it was sounding.
+void testRoutingChangeWhileSounding() {
+	VirtualClock clock;
+	EventLogOutput log(clock);
+	Sequencer sequencer;
+	sequencer.setTickSource(&clock);
+	sequencer.setOutput(&log);
+	Song song = songOf({note(0, 60, 1000)});
+	song.tracks[0].alsaClient = 20;
+	song.tracks[0].alsaPort = 0;
+	song.tracks.push_back(songOf({note(0, 62, 1000)}).tracks[0]);
+	song.tracks[1].alsaClient = 21;
+	song.tracks[1].alsaPort = 0;
+	sequencer.setSong(song);
+	sequencer.play(0);
+	clock.advanceTo(300);
+	song.tracks[0].alsaClient = 21;
+	sequencer.setSong(song);
+	clock.advanceTo(500);
+	std::swap(song.tracks[0], song.tracks[1]);
+	sequencer.setSong(song);
+	clock.run(2000);
+	sequencer.stop();
+
+	const auto on60 = entriesOf(log, MidiStatus::NoteOn, 60);
+	const auto off60 = entriesOf(log, MidiStatus::NoteOff, 60);
+	check(on60.size() == 1 && off60.size() == 1 && off60[0].tick == 1000, "moved note ends once, on time");
+	check(!on60.empty() && !off60.empty() && off60[0].destination == on60[0].destination,
+		"off sent to the note's destination after a port change");
+	const auto on62 = entriesOf(log, MidiStatus::NoteOn, 62);
+	const auto off62 = entriesOf(log, MidiStatus::NoteOff, 62);
+	check(on62.size() == 1 && off62.size() == 1 && off62[0].destination == on62[0].destination,
+		"off sent to the note's destination after a reorder");
+}
+
+// An edit while playing that routes a track to a new port adds no port from the edit:
+// the track plays on the default output until the next play() adds it.
+void testNewPortWhilePlaying() {
+	VirtualClock clock;
+	EventLogOutput log(clock);
+	Sequencer sequencer;
+	sequencer.setTickSource(&clock);
+	sequencer.setOutput(&log);
+	Song song = songOf({note(100, 60, 10), note(300, 61, 10)});
+	sequencer.setSong(song);
+	sequencer.play(0);
+	clock.advanceTo(200);
+	song.tracks[0].alsaClient = 22;
+	song.tracks[0].alsaPort = 0;
+	sequencer.setSong(song);
+	clock.run(1000);
+	sequencer.stop();
+	check(log.findDestination(22, 0) == 0, "no port added while playing");
+	const auto on61 = entriesOf(log, MidiStatus::NoteOn, 61);
+	check(on61.size() == 1 && on61[0].destination == 0, "new port falls back to the default output");
+
+	log.clear();
+	sequencer.play(0);
+	clock.run(1000);
+	sequencer.stop();
+	const uint16_t added = log.findDestination(22, 0);
+	const auto replayed = entriesOf(log, MidiStatus::NoteOn, 61);
+	check(added != 0 && replayed.size() == 1 && replayed[0].destination == added, "added by the next play()",
+		added);
+}
+
+// Playing from a position with output offsets: notes moved ahead of it play right at
+// the start, notes from before it moved past it stay silent, the rest play shifted.
+void testOffsetsAtStart() {
+	VirtualClock clock;
+	EventLogOutput log(clock);
+	Sequencer sequencer;
+	sequencer.setTickSource(&clock);
+	sequencer.setOutput(&log);
+	Song song = songOf({note(100, 60, 20)});
+	song.bpm = 125.0; // 4 ms per tick
+	const std::pair<double, std::vector<MidiEvent>> tracks[] = {
+		{-12.0, {note(100, 61, 20), note(150, 64, 10)}}, {8.0, {note(99, 62, 20), note(100, 63, 10)}}};
+	for (const auto& [offsetMs, events] : tracks) {
+		Track track;
+		track.offsetMs = offsetMs;
+		MidiItem item;
+		item.events = events;
+		track.items.push_back(item);
+		song.tracks.push_back(track);
+	}
+	sequencer.setSong(song);
+	sequencer.play(100);
+	clock.run(1000);
+	sequencer.stop();
+
+	const auto early = ticksOf(log, MidiStatus::NoteOn, 61);
+	check(early.size() == 1 && early[0] == 100, "note moved ahead of the start plays at it", early.empty() ? 0 : early[0]);
+	check(ticksOf(log, MidiStatus::NoteOn, 64) == std::vector<uint64_t>{147}, "early track plays ahead");
+	check(ticksOf(log, MidiStatus::NoteOn, 62).empty() && ticksOf(log, MidiStatus::NoteOff, 62).empty(),
+		"note from before the start stays silent");
+	check(ticksOf(log, MidiStatus::NoteOn, 63) == std::vector<uint64_t>{102}, "late track plays behind");
+	check(ticksOf(log, MidiStatus::NoteOn, 60) == std::vector<uint64_t>{100}, "track without offset on time");
+}
+
+// Dispatch telemetry: per-kind and per-track lateness, measured from each event's own
+// deadline, with the late count and in-flight gauges.
+void testDispatchStats() {
+	VirtualClock clock;
+	EventLogOutput log(clock);
+	Sequencer sequencer;
+	sequencer.setTickSource(&clock);
+	sequencer.setOutput(&log);
+	MidiEvent volume = note(105, 7, 0);
+	volume.status = MidiStatus::ControlChange;
+	Song song = songOf({note(100, 60, 10), volume});
+	song.bpm = 125.0; // 4 ms per tick
+	Track early;
+	early.offsetMs = -8.0;
+	MidiItem item;
+	item.events = {note(100, 61, 20)};
+	early.items.push_back(item);
+	song.tracks.push_back(early);
+	sequencer.setSong(song);
+	clock.setTickLateness(500000);
+	sequencer.play(100); // The early note is two ticks overdue at the start
+	clock.run(1000);
+	sequencer.stop();
+
+	const DispatchStats& stats = sequencer.dispatchStats();
+	check(stats.events.load() == 5, "every sent event recorded", stats.events.load());
+	check(stats.late.load() == 1, "only the held-over note is late", stats.late.load());
+	check(stats.byKind[DispatchStats::NoteOn].count() == 2 && stats.byKind[DispatchStats::NoteOff].count() == 2 &&
+		stats.byKind[DispatchStats::ControlChange].count() == 1, "recorded by kind");
+	check(stats.byTrack[1].count() == 2 && stats.byTrack[1].summary().maxNs == 8500000, "held-over lateness",
+		stats.byTrack[1].summary().maxNs);
+	check(stats.byTrack[0].summary().maxNs == 500000, "on-time lateness", stats.byTrack[0].summary().maxNs);
+	check(stats.maxQueueDepth.load() == 2, "both starting notes in one batch", stats.maxQueueDepth.load());
+	check(stats.maxPendingNoteOffs.load() == 2 && stats.pendingNoteOffs.load() == 0, "pending note-offs",
+		stats.maxPendingNoteOffs.load());
+}
+
+// Tracks past the per-track histograms share the last one, and the dump says so.
+void testDispatchStatsSharedTrack() {
+	DispatchStats stats;
+	stats.record(DispatchStats::NoteOn, 63, 1000);
+	stats.record(DispatchStats::NoteOn, 200, 2000);
+	check(stats.byTrack[DispatchStats::MAX_TRACKS - 1].count() == 2, "late tracks share the last histogram");
+	std::ostringstream out;
+	stats.write(out);
+	check(out.str().find("dispatch_track_63_plus") != std::string::npos, "shared histogram labelled as such");
+	check(out.str().find("dispatch_track_63 ") == std::string::npos, "not credited to track 63 alone");
+}
+
+} // namespace
+
+int main() {
+	testEditWhilePlaying();
+	testRepeatedEdits();
+	testLiveMuteSolo();
+	testMutedDuplicateNote();
+	testPlayChasesState();
+	testSeekResetsUnsetState();
+	testPauseResume();
+	testLatePolicy();
+	testTrackRouting();
+	testRoutingChangeWhileSounding();
+	testNewPortWhilePlaying();
+	testOffsetsAtStart();
+	testDispatchStats();
+	testDispatchStatsSharedTrack();
+	return finish("test_live_edit");
+}
@@ -0,0 +1,223 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "audio/EventLogOutput.h"
+#include "core/Sequencer.h"
+#include "core/VirtualClock.h"
+#include "TestSupport.h"
+
+using namespace linearseq;
+using namespace linearseq::test;
+
+namespace {
+
+constexpr int PASSES = 50;
+
+Song loopSong(const std::vector<MidiEvent>& events, uint32_t loopStart, uint32_t loopEnd) {
+	Song song = songOf(events);
+	song.loopEnabled = true;
+	song.loopStart = loopStart;
+	song.loopEnd = loopEnd;
+	return song;
+}
+
+// Exact (unrounded) time from tick `from` to `to` on the map.
+long double exactNs(const TempoMap& map, uint64_t from, uint64_t to) {
+	long double total = 0;
+	for (uint64_t tick = from; tick < to;) {
+		const size_t index = map.segmentIndexAt(tick);
+		const auto& segments = map.segments();
+		const uint64_t end = index + 1 < segments.size() ? std::min(to, segments[index + 1].startTick) : to;
+		total += static_cast<long double>(end - tick) * TempoMap::PERIOD_NUMERATOR / segments[index].periodDenominator;
+		tick = end;
+	}
+	return total;
+}
+
+// Plays PASSES passes and measures how far each pass's first note lands from where
+// pass k should start: loop start time plus k exact loop durations on the song's own
+// map. Returns the worst error in nanoseconds beyond the map's own rounding (1 ns per
+// tempo segment started, see TempoMap), or -1 if a pass is missing.
+int64_t worstWrapErrorNs(const Song& song) {
+	VirtualClock clock;
+	EventLogOutput log(clock);
+	Sequencer sequencer;
+	sequencer.setTickSource(&clock);
+	sequencer.setOutput(&log);
+	sequencer.setSong(song);
+	const TempoMap map = TempoMap::fromSong(song);
+	const long double startNs = exactNs(map, 0, song.loopStart);
+	const long double loopNs = exactNs(map, song.loopStart, song.loopEnd);
+	const uint64_t length = song.loopEnd - song.loopStart;
+	const TempoMap playback = map.looped(song.loopStart, song.loopEnd);
+
+	sequencer.play(song.loopStart);
+	clock.run(song.loopEnd + PASSES * length - 1);
+	sequencer.stop();
+
+	const auto ons = entriesOf(log, MidiStatus::NoteOn, 60);
+	if (ons.size() != PASSES + 1) {
+		return -1;
+	}
+	long double worst = 0;
+	for (size_t pass = 0; pass < ons.size(); ++pass) {
+		if (ons[pass].tick != song.loopStart + pass * length) {
+			return -1;
+		}
+		const long double expected = startNs + static_cast<long double>(pass) * loopNs;
+		const long double rounding = static_cast<long double>(playback.segmentIndexAt(ons[pass].tick) + 1);
+		worst = std::max(worst, std::fabs(static_cast<long double>(ons[pass].timeNs) - expected) - rounding);
+	}
+	return static_cast<int64_t>(std::ceil(worst));
+}
+
+// Each pass starts exactly one loop duration after the previous one, at a constant
+// tempo and with a tempo change inside the loop.
+void testWrapTiming() {
+	Song song = loopSong({note(0, 60, 100), note(240, 61, 100)}, 0, 480);
+	song.bpm = 133.0;
+	const int64_t constant = worstWrapErrorNs(song);
+	check(constant == 0, "constant tempo wraps on time", constant);
+
+	song.tempoEvents.push_back({300, 75.5});
+	song.tempoEvents.push_back({2000, 200.0}); // Past the loop: never reached
+	const int64_t changing = worstWrapErrorNs(song);
+	check(changing == 0, "tempo change inside the loop wraps on time", changing);
+
+	Song offset = loopSong({note(960, 60, 100)}, 960, 1440);
+	offset.tempoEvents.push_back({500, 90.0});
+	offset.tempoEvents.push_back({1200, 150.0});
+	const int64_t shifted = worstWrapErrorNs(offset);
+	check(shifted == 0, "loop after a tempo change wraps on time", shifted);
+}
+
+// A short loop with a tempo change keeps its tempo far past where unrolling would have
+// stopped: every pass lasts the loop's exact duration, and ticks round-trip.
+void testManyPasses() {
+	Song song = loopSong({}, 100, 104);
+	song.tempoEvents.push_back({102, 97.0});
+	const TempoMap map = TempoMap::fromSong(song);
+	const TempoMap playback = map.looped(song.loopStart, song.loopEnd);
+	const long double startNs = exactNs(map, 0, song.loopStart);
+	const long double loopNs = exactNs(map, song.loopStart, song.loopEnd);
+	int64_t worst = 0;
+	bool roundTrip = true;
+	for (uint64_t pass : {1ULL, 4095ULL, 4096ULL, 4097ULL, 100000ULL, 10000000ULL}) {
+		const uint64_t tick = song.loopStart + pass * 4;
+		const long double expected = startNs + static_cast<long double>(pass) * loopNs;
+		worst = std::max(worst, static_cast<int64_t>(std::ceil(
+			std::fabs(static_cast<long double>(playback.tickToNs(tick)) - expected))));
+		for (uint64_t t = tick; t < tick + 4; ++t) {
+			roundTrip = roundTrip && playback.nsToTick(playback.tickToNs(t)) == t &&
+				playback.bpmAt(t) == map.bpmAt(playback.foldTick(t));
+		}
+	}
+	check(worst <= 2, "pass starts stay on the exact loop duration", worst);
+	check(roundTrip, "ticks past the loop round-trip with the loop's tempo");
+}
+
+// A note running over the loop end is released at the wrap, ahead of the next pass;
+// events before the loop play once; the reported position stays inside the loop.
+void testWrapReleasesAndPosition() {
+	VirtualClock clock;
+	EventLogOutput log(clock);
+	Sequencer sequencer;
+	sequencer.setTickSource(&clock);
+	sequencer.setOutput(&log);
+	sequencer.setSong(loopSong({note(0, 59, 10), note(480, 60, 100), note(800, 62, 400)}, 480, 960));
+	sequencer.play(0);
+	clock.run(960 + 3 * 480 - 1);
+	check(sequencer.currentTick() >= 480 && sequencer.currentTick() < 960, "position stays in the loop",
+		static_cast<long long>(sequencer.currentTick()));
+	check(!sequencer.shouldStop(), "a loop never requests stop");
+	sequencer.stop();
+
+	check(entriesOf(log, MidiStatus::NoteOn, 59).size() == 1, "lead-in plays once");
+	const auto offs = entriesOf(log, MidiStatus::NoteOff, 62);
+	check(offs.size() == 3, "crossing note released at every wrap", static_cast<long long>(offs.size()));
+	for (size_t pass = 0; pass < offs.size(); ++pass) {
+		check(offs[pass].tick == 960 + pass * 480, "released at the wrap", static_cast<long long>(offs[pass].tick));
+	}
+	// At each wrap tick the release comes before the next pass's first note.
+	const auto entries = log.entries();
+	for (size_t i = 0; i + 1 < entries.size(); ++i) {
+		if (entries[i].status == MidiStatus::NoteOn && entries[i].data1 == 60 && entries[i].tick > 480) {
+			check(entries[i - 1].status == MidiStatus::NoteOff && entries[i - 1].data1 == 62,
+				"wrap releases before the next pass", static_cast<long long>(entries[i].tick));
+		}
+	}
+}
+
+// Each wrap restores the channel state of the loop start: a controller changed inside
+// the loop goes back to its value from before the loop, a bend set inside it is
+// centered, and state the pass left unchanged is not sent again.
+void testWrapChasesState() {
+	VirtualClock clock;
+	EventLogOutput log(clock);
+	Sequencer sequencer;
+	sequencer.setTickSource(&clock);
+	sequencer.setOutput(&log);
+	MidiEvent program = note(0, 5, 0);
+	program.status = MidiStatus::ProgramChange;
+	MidiEvent volume = note(0, 7, 0);
+	volume.status = MidiStatus::ControlChange;
+	volume.data2 = 50;
+	MidiEvent louder = note(600, 7, 0);
+	louder.status = MidiStatus::ControlChange;
+	louder.data2 = 90;
+	MidiEvent bend = note(700, 0, 0);
+	bend.status = MidiStatus::PitchBend;
+	bend.data2 = 0x50;
+	sequencer.setSong(loopSong({program, volume, louder, bend, note(480, 60, 10)}, 480, 960));
+	sequencer.play(0);
+	clock.run(960 + 2 * 480 - 1);
+	sequencer.stop();
+
+	const auto volumes = entriesOf(log, MidiStatus::ControlChange, 7);
+	check(volumes.size() == 6, "volume set and restored on every pass", static_cast<long long>(volumes.size()));
+	for (size_t pass = 1; pass < 3 && 2 * pass < volumes.size(); ++pass) {
+		const auto& restored = volumes[2 * pass];
+		check(restored.tick == 480 + pass * 480 && restored.data2 == 50, "volume from the loop start at the wrap",
+			static_cast<long long>(restored.tick));
+	}
+	size_t centered = 0;
+	for (const auto& entry : log.entries()) {
+		if (entry.status == MidiStatus::PitchBend && entry.data1 == 0 && entry.data2 == 0x40) {
+			check(entry.tick == 960 || entry.tick == 1440, "bend centered at the wrap", static_cast<long long>(entry.tick));
+			++centered;
+		}
+	}
+	check(centered == 2, "bend centered once per wrap", static_cast<long long>(centered));
+	check(entriesOf(log, MidiStatus::ProgramChange, 5).size() == 1, "unchanged program not resent");
+}
+
+// Starting at or past the loop end plays through to the end as usual.
+void testStartPastLoop() {
+	VirtualClock clock;
+	EventLogOutput log(clock);
+	Sequencer sequencer;
+	sequencer.setTickSource(&clock);
+	sequencer.setOutput(&log);
+	sequencer.setSong(loopSong({note(0, 60, 10), note(1000, 61, 10)}, 0, 480));
+	sequencer.play(480);
+	clock.run(5000);
+	check(sequencer.shouldStop(), "playback past the loop ends");
+	sequencer.stop();
+	check(entriesOf(log, MidiStatus::NoteOn, 61).size() == 1 && entriesOf(log, MidiStatus::NoteOn, 60).empty(),
+		"only the part after the loop plays");
+}
+
+} // namespace
+
+int main() {
+	testWrapTiming();
+	testManyPasses();
+	testWrapReleasesAndPosition();
+	testWrapChasesState();
+	testStartPastLoop();
+	return finish("test_loop");
+}
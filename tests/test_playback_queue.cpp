@@ -0,0 +1,430 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <map>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "core/PlaybackQueue.h"
+
+using linearseq::ChaseState;
+using linearseq::MidiEvent;
+using linearseq::MidiItem;
+using linearseq::MidiStatus;
+using linearseq::PlaybackEvent;
+using linearseq::PlaybackQueueBuilder;
+using linearseq::PlaybackSnapshot;
+using linearseq::Song;
+using linearseq::Track;
+using linearseq::TrackMask;
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const char* what, unsigned long long detail = 0) {
+	if (!condition) {
+		std::printf("FAIL: %s (%llu)\n", what, detail);
+		++failures;
+	}
+}
+
+MidiEvent note(uint32_t tick, uint8_t pitch, uint32_t duration) {
+	MidiEvent event;
+	event.tick = tick;
+	event.data1 = pitch;
+	event.data2 = 100;
+	event.duration = duration;
+	return event;
+}
+
+Song songOf(const std::vector<MidiEvent>& events) {
+	Song song;
+	Track track;
+	track.channel = 3;
+	MidiItem item;
+	item.events = events;
+	track.items.push_back(item);
+	song.tracks.push_back(track);
+	return song;
+}
+
+bool matches(const PlaybackEvent& event, uint64_t tick, MidiStatus status, uint8_t pitch) {
+	return event.absTick == tick && event.status == status && event.data1 == pitch && event.channel == 3;
+}
+
+// Every note with a duration gets an explicit note-off, and the stream is tick ordered.
+void testNoteOffsAreExpanded() {
+	const auto queue = linearseq::PlaybackQueue::build(songOf({note(10, 60, 5), note(0, 62, 30)}));
+	check(queue.size() == 4, "two notes expand to four events", queue.size());
+	if (queue.size() != 4) {
+		return;
+	}
+	check(matches(queue[0], 0, MidiStatus::NoteOn, 62), "first note-on");
+	check(matches(queue[1], 10, MidiStatus::NoteOn, 60), "second note-on");
+	check(matches(queue[2], 15, MidiStatus::NoteOff, 60), "second note-off");
+	check(matches(queue[3], 30, MidiStatus::NoteOff, 62), "first note-off");
+	check(queue[2].data2 == 0, "note-off velocity 0");
+}
+
+// A pitch re-struck exactly when it ends is released first, then played again.
+void testOffBeforeOnAtSameTick() {
+	const auto queue = linearseq::PlaybackQueue::build(songOf({note(0, 60, 10), note(10, 60, 10)}));
+	check(queue.size() == 4, "back-to-back notes keep both offs", queue.size());
+	if (queue.size() != 4) {
+		return;
+	}
+	check(matches(queue[1], 10, MidiStatus::NoteOff, 60), "off at 10 precedes on");
+	check(matches(queue[2], 10, MidiStatus::NoteOn, 60), "on at 10 follows off");
+	check(matches(queue[3], 20, MidiStatus::NoteOff, 60), "second note ends at 20");
+}
+
+// Overlapping notes on one pitch retrigger; the older note's own off is dropped.
+void testOverlapRetriggers() {
+	const auto queue = linearseq::PlaybackQueue::build(songOf({note(0, 60, 100), note(50, 60, 100)}));
+	check(queue.size() == 4, "overlap yields on, off, on, off", queue.size());
+	if (queue.size() != 4) {
+		return;
+	}
+	check(matches(queue[1], 50, MidiStatus::NoteOff, 60), "retrigger off at 50");
+	check(matches(queue[2], 50, MidiStatus::NoteOn, 60), "second on at 50");
+	check(matches(queue[3], 150, MidiStatus::NoteOff, 60), "only the second note's off remains");
+
+	// A short note inside a long one ends the pitch at its own off.
+	const auto nested = linearseq::PlaybackQueue::build(songOf({note(0, 60, 100), note(20, 60, 10)}));
+	check(nested.size() == 4, "nested note yields four events", nested.size());
+	if (nested.size() == 4) {
+		check(matches(nested[3], 30, MidiStatus::NoteOff, 60), "nested note releases at 30");
+	}
+}
+
+// Same-pitch notes on different tracks do not retrigger in the stream: each keeps its
+// own off, and playback decides among the tracks that are heard.
+void testOverlapAcrossTracks() {
+	Song song = songOf({note(0, 60, 100)});
+	song.tracks.push_back(songOf({note(50, 60, 100)}).tracks[0]);
+	const auto queue = linearseq::PlaybackQueue::build(song);
+	check(queue.size() == 4, "no retrigger off between tracks", queue.size());
+	if (queue.size() != 4) {
+		return;
+	}
+	check(matches(queue[1], 50, MidiStatus::NoteOn, 60) && queue[1].track == 1, "second track's on");
+	check(matches(queue[2], 100, MidiStatus::NoteOff, 60) && queue[2].track == 0, "first track keeps its off");
+	check(matches(queue[3], 150, MidiStatus::NoteOff, 60) && queue[3].track == 1, "second track keeps its off");
+
+	// With the second track silenced, the first track's note holds the voice to its end.
+	const PlaybackSnapshot snapshot(queue);
+	TrackMask mask;
+	song.tracks[1].mute = true;
+	mask.update(song);
+	const PlaybackEvent* held = snapshot.noteSoundingAt(linearseq::voiceSlot(3, 60), 2, mask);
+	check(held && held->track == 0, "muted track's note does not take the voice");
+	song.tracks[1].mute = false;
+	mask.update(song);
+	held = snapshot.noteSoundingAt(linearseq::voiceSlot(3, 60), 2, mask);
+	check(held && held->track == 1, "heard track's note takes the voice");
+	check(!snapshot.noteSoundingAt(linearseq::voiceSlot(3, 60), 4, mask), "released at the end");
+}
+
+// Every track is in the stream, tagged with its index; mute and solo only set the mask.
+void testMuteAndSolo() {
+	Song song = songOf({note(0, 60, 10)});
+	song.tracks.push_back(song.tracks.front());
+	song.tracks[1].items[0].events[0].data1 = 61;
+	song.tracks[1].solo = true;
+	song.tracks[0].mute = true;
+	const auto queue = linearseq::PlaybackQueue::build(song);
+	check(queue.size() == 4, "muted and non-solo tracks stay in the stream", queue.size());
+	if (queue.size() == 4) {
+		check(queue[0].track == 0 && queue[0].data1 == 60 && queue[1].track == 1, "events carry their track");
+	}
+
+	TrackMask mask;
+	check(mask.enabled(0) && mask.enabled(1) && mask.enabled(500), "every track enabled by default");
+	const uint64_t version = mask.version();
+	mask.update(song);
+	check(mask.version() != version, "update bumps the version");
+	check(!mask.enabled(0) && mask.enabled(1), "solo keeps only the soloed track");
+	song.tracks[1].mute = true;
+	mask.update(song);
+	check(!mask.enabled(0) && !mask.enabled(1), "muted solo track and non-solo track are both silent");
+	song.tracks[0].mute = false;
+	song.tracks[1] = song.tracks[0];
+	mask.update(song);
+	check(mask.enabled(0) && mask.enabled(1) && mask.enabled(70), "unmuted tracks and unused bits enabled");
+}
+
+// Straightforward reference: expand everything, one global stable sort, then resolve.
+std::vector<PlaybackEvent> referenceBuild(const Song& song) {
+	constexpr uint32_t none = std::numeric_limits<uint32_t>::max();
+	struct Entry {
+		PlaybackEvent event;
+		uint32_t voice;
+	};
+	std::vector<Entry> entries;
+	uint32_t voices = 0;
+	for (size_t index = 0; index < song.tracks.size(); ++index) {
+		const Track& track = song.tracks[index];
+		for (const auto& item : track.items) {
+			for (const auto& event : item.events) {
+				Entry entry{{item.startTick + event.tick, event.status, track.channel,
+					event.data1, event.data2, static_cast<uint16_t>(index)}, none};
+				const bool on = event.status == MidiStatus::NoteOn && event.data2 > 0;
+				if (on) {
+					entry.voice = voices++;
+				}
+				entries.push_back(entry);
+				if (on && event.duration > 0) {
+					entry.event.absTick += event.duration;
+					entry.event.status = MidiStatus::NoteOff;
+					entry.event.data2 = 0;
+					entries.push_back(entry);
+				}
+			}
+		}
+	}
+	std::stable_sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+		if (a.event.absTick != b.event.absTick) {
+			return a.event.absTick < b.event.absTick;
+		}
+		return linearseq::PlaybackQueue::isNoteOff(a.event) && !linearseq::PlaybackQueue::isNoteOff(b.event);
+	});
+	// Overlaps are resolved per track: owner by voice slot and track.
+	std::map<std::pair<size_t, uint16_t>, uint32_t> owner;
+	std::vector<PlaybackEvent> queue;
+	for (const auto& entry : entries) {
+		const PlaybackEvent& event = entry.event;
+		if (event.status != MidiStatus::NoteOn && event.status != MidiStatus::NoteOff) {
+			queue.push_back(event);
+			continue;
+		}
+		const auto key = std::make_pair(linearseq::voiceSlot(event.channel, event.data1), event.track);
+		uint32_t& current = owner.emplace(key, none).first->second;
+		if (linearseq::PlaybackQueue::isNoteOff(event)) {
+			if (entry.voice == none || entry.voice == current) {
+				current = none;
+				queue.push_back(event);
+			}
+			continue;
+		}
+		if (current != none) {
+			PlaybackEvent off = event;
+			off.status = MidiStatus::NoteOff;
+			off.data2 = 0;
+			queue.push_back(off);
+		}
+		current = entry.voice;
+		queue.push_back(event);
+	}
+	return queue;
+}
+
+bool sameStream(const std::vector<PlaybackEvent>& a, const std::vector<PlaybackEvent>& b) {
+	return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](const PlaybackEvent& x, const PlaybackEvent& y) {
+		return x.absTick == y.absTick && x.status == y.status && x.channel == y.channel &&
+			x.data1 == y.data1 && x.data2 == y.data2 && x.track == y.track;
+	});
+}
+
+Song randomSong(std::mt19937& rng, int tracks, int items, int events) {
+	Song song;
+	for (int t = 0; t < tracks; ++t) {
+		Track track;
+		track.channel = static_cast<uint8_t>(rng() % 3);
+		for (int i = 0; i < items; ++i) {
+			MidiItem item;
+			item.startTick = static_cast<uint32_t>(rng() % 2000);
+			for (int e = 0; e < events; ++e) {
+				MidiEvent event = note(static_cast<uint32_t>(rng() % 500), static_cast<uint8_t>(60 + rng() % 4),
+					static_cast<uint32_t>(rng() % 60));
+				if (rng() % 8 == 0) {
+					event.status = MidiStatus::ControlChange;
+				}
+				item.events.push_back(event);
+			}
+			track.items.push_back(item);
+		}
+		song.tracks.push_back(track);
+	}
+	return song;
+}
+
+// The run cache merges to exactly the stream of a full rebuild, and after an edit only
+// re-sorts the items that changed. Moving an item re-sorts nothing.
+void testIncrementalBuild() {
+	std::mt19937 rng(1234);
+	PlaybackQueueBuilder builder;
+	Song song = randomSong(rng, 4, 5, 40);
+	check(sameStream(builder.build(song), referenceBuild(song)), "runs merge to the reference stream");
+	check(builder.lastStats().rebuiltRuns == 20, "first build sorts every item", builder.lastStats().rebuiltRuns);
+
+	song.tracks[2].items[3].startTick += 77;
+	check(sameStream(builder.build(song), referenceBuild(song)), "moved item merges correctly");
+	check(builder.lastStats().rebuiltRuns == 0, "moving an item re-sorts nothing", builder.lastStats().rebuiltRuns);
+
+	song.tracks[1].items[0].events[5].tick += 3;
+	song.tracks[1].channel = 9;
+	song.tracks[3].items[4].events.push_back(note(10, 61, 5));
+	check(sameStream(builder.build(song), referenceBuild(song)), "edited items merge correctly");
+	check(builder.lastStats().rebuiltRuns == 2, "only edited items are re-sorted", builder.lastStats().rebuiltRuns);
+
+	const auto unsoloed = builder.build(song);
+	song.tracks[0].solo = true;
+	check(sameStream(builder.build(song), unsoloed), "solo leaves the stream alone");
+	check(builder.lastStats().items == 20 && builder.lastStats().rebuiltRuns == 0, "solo re-sorts nothing",
+		builder.lastStats().rebuiltRuns);
+
+	for (int round = 0; round < 20; ++round) {
+		const Song other = randomSong(rng, 1 + static_cast<int>(rng() % 4), 1 + static_cast<int>(rng() % 6), 30);
+		if (!sameStream(builder.build(other), referenceBuild(other))) {
+			check(false, "random song matches the reference", static_cast<unsigned long long>(round));
+			return;
+		}
+	}
+}
+
+// Large builds expand items on worker threads; the stream must not depend on it.
+void testParallelBuild() {
+	std::mt19937 rng(99);
+	const Song song = randomSong(rng, 8, 40, 200);
+	PlaybackQueueBuilder serial;
+	serial.setMaxThreads(1);
+	PlaybackQueueBuilder parallel;
+	parallel.setMaxThreads(4);
+	const auto expected = serial.build(song);
+	check(sameStream(parallel.build(song), expected), "parallel build matches the serial one");
+	check(parallel.lastStats().rebuiltRuns == 320, "every item expanded once", parallel.lastStats().rebuiltRuns);
+	check(sameStream(expected, referenceBuild(song)), "large build matches the reference");
+}
+
+bool sameState(const ChaseState& a, const ChaseState& b) {
+	return a.controllers == b.controllers && a.programs == b.programs && a.bends == b.bends;
+}
+
+// Chase state from checkpoints equals a scan from the start, at and between checkpoints.
+void testChaseState() {
+	PlaybackEvent bend{10, MidiStatus::PitchBend, 2, 0x01, 0x40};
+	PlaybackEvent program{10, MidiStatus::ProgramChange, 2, 5, 0};
+	PlaybackEvent volume{20, MidiStatus::ControlChange, 2, 7, 90};
+	PlaybackEvent reset{30, MidiStatus::ControlChange, 2, 121, 0};
+	PlaybackEvent allOff{30, MidiStatus::ControlChange, 2, 123, 0};
+	const PlaybackSnapshot small({bend, program, volume, reset, allOff}, 16);
+	ChaseState at20 = small.chaseStateAt(20);
+	check(at20.bends[2] == 0x2001 && at20.programs[2] == 5, "bend and program chased");
+	check(at20.controllers[2][7] == ChaseState::UNSET, "events at the tick itself are not chased");
+	check(small.chaseStateAt(21).controllers[2][7] == 90, "controller chased");
+	const ChaseState after = small.chaseStateAt(40);
+	check(after.controllers[2][7] == ChaseState::UNSET && after.bends[2] == ChaseState::BEND_UNSET &&
+		after.programs[2] == 5, "reset all controllers clears controllers and bend, not program");
+	check(after.controllers[2][123] == ChaseState::UNSET, "channel mode messages are not chased");
+	check(small.chaseStateAt(0).empty(), "nothing chased at the start");
+
+	std::mt19937 rng(5);
+	std::vector<PlaybackEvent> events;
+	uint32_t tick = 0;
+	for (int i = 0; i < 5000; ++i) {
+		tick += rng() % (rng() % 50 == 0 ? 5000 : 8);
+		const uint32_t kind = rng() % 4;
+		const auto status = kind == 0 ? MidiStatus::NoteOn : kind == 1 ? MidiStatus::ControlChange :
+			kind == 2 ? MidiStatus::ProgramChange : MidiStatus::PitchBend;
+		events.push_back({tick, status, static_cast<uint8_t>(rng() % 16), static_cast<uint8_t>(rng() % 128),
+			static_cast<uint8_t>(rng() % 128)});
+	}
+	const PlaybackSnapshot snapshot(events, 480);
+	ChaseState scanned;
+	size_t next = 0;
+	for (uint64_t at = 0; at <= tick + 1; at += 1 + rng() % 97) {
+		while (next < events.size() && events[next].absTick < at) {
+			scanned.apply(events[next++]);
+		}
+		if (!sameState(snapshot.chaseStateAt(at), scanned)) {
+			check(false, "checkpointed chase matches a full scan", at);
+			return;
+		}
+	}
+}
+
+// A track's offset plus its port's moves its events by whole ticks at the tempo in
+// effect, never before tick 0 or across the loop bounds; each event keeps its song tick.
+void testOutputOffsets() {
+	Song song;
+	song.bpm = 125.0; // 4 ms per tick at the default PPQN
+	song.portOffsets.push_back({20, 0, -2.0});
+	const std::pair<double, int> settings[] = {{0.0, -1}, {-10.0, 20}, {8.0, -1}};
+	for (const auto& [offsetMs, client] : settings) {
+		Track track;
+		track.channel = 3;
+		track.offsetMs = offsetMs;
+		track.alsaClient = client;
+		track.alsaPort = 0;
+		MidiItem item;
+		item.events = {note(100, static_cast<uint8_t>(60 + song.tracks.size()), 20)};
+		if (song.tracks.size() == 1) {
+			item.events.push_back(note(1, 70, 10)); // Would move before tick 0
+		}
+		track.items.push_back(item);
+		song.tracks.push_back(track);
+	}
+
+	const auto queue = linearseq::PlaybackQueue::build(song);
+	const std::pair<uint64_t, uint8_t> expected[] = {{0, 70}, {8, 70}, {97, 61}, {100, 60}, {102, 62}, {117, 61},
+		{120, 60}, {122, 62}};
+	check(queue.size() == 8, "offset stream size", queue.size());
+	for (size_t i = 0; i < queue.size() && i < 8; ++i) {
+		check(queue[i].absTick == expected[i].first && queue[i].data1 == expected[i].second, "offset dispatch tick", i);
+	}
+	for (const auto& event : queue) {
+		const uint32_t songTick = event.data1 == 70 ? (event.status == MidiStatus::NoteOn ? 1 : 11)
+			: (event.status == MidiStatus::NoteOn ? 100 : 120);
+		check(event.songTick() == songTick, "song tick kept", event.absTick);
+	}
+	const PlaybackSnapshot snapshot(queue);
+	check(snapshot.lead() == 3 && snapshot.lag() == 2, "snapshot lead and lag", snapshot.lead() * 10 + snapshot.lag());
+
+	check(linearseq::PlaybackQueue::outputOffsetMs(song, song.tracks[1]) == -12.0, "port offset added");
+	check(std::fabs(linearseq::PlaybackQueue::minOutputOffsetMs(song) - 4.0) < 1e-9, "one tick at 125 BPM");
+	song.tempoEvents.push_back({1000, 62.5});
+	check(std::fabs(linearseq::PlaybackQueue::minOutputOffsetMs(song) - 8.0) < 1e-9, "one tick at the slowest tempo");
+	song.tempoEvents.clear();
+
+	// Loop [100, 200): the early note stays at the loop start, the late one before its end.
+	song.loopEnabled = true;
+	song.loopStart = 100;
+	song.loopEnd = 200;
+	song.tracks[2].items[0].events = {note(199, 62, 0)};
+	const auto looped = linearseq::PlaybackQueue::build(song);
+	for (const auto& event : looped) {
+		if (event.status == MidiStatus::NoteOn && event.data1 == 61) {
+			check(event.absTick == 100, "offset stops at the loop start", event.absTick);
+		}
+		if (event.status == MidiStatus::NoteOn && event.data1 == 62) {
+			check(event.absTick == 199, "offset stops before the loop end", event.absTick);
+		}
+		if (event.status == MidiStatus::NoteOn && event.data1 == 70) {
+			check(event.absTick == 0, "pre-loop event stays before the loop", event.absTick);
+		}
+	}
+}
+
+} // namespace
+
+int main() {
+	testNoteOffsAreExpanded();
+	testOffBeforeOnAtSameTick();
+	testOverlapRetriggers();
+	testOverlapAcrossTracks();
+	testMuteAndSolo();
+	testIncrementalBuild();
+	testParallelBuild();
+	testChaseState();
+	testOutputOffsets();
+	if (failures > 0) {
+		std::printf("%d check(s) failed\n", failures);
+		return 1;
+	}
+	std::printf("test_playback_queue: all checks passed\n");
+	return 0;
+}
@@ -0,0 +1,114 @@
+#include <cstdint>
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "audio/EventLogOutput.h"
+#include "core/Sequencer.h"
+#include "core/VirtualClock.h"
+#include "TestSupport.h"
+
+using namespace linearseq;
+using namespace linearseq::test;
+
+namespace {
+
+// 125 BPM at 120 PPQN: exactly 4 ms per tick.
+Song twoNoteSong() {
+	Song song;
+	song.bpm = 125.0;
+	Track track;
+	track.channel = 2;
+	MidiItem item;
+	item.events = {note(0, 60, 120), note(240, 64, 60)};
+	track.items.push_back(item);
+	song.tracks.push_back(track);
+	return song;
+}
+
+bool logged(const EventLogOutput::Entry& entry, uint64_t tick, int64_t timeNs, MidiStatus status, uint8_t pitch) {
+	return entry.tick == tick && entry.timeNs == timeNs && entry.status == status &&
+		entry.channel == 2 && entry.data1 == pitch;
+}
+
+// A song rendered on the virtual clock logs every message at its tick and exact
+// tempo-map time, then requests stop once the last note-off has gone out.
+void testTwoNoteRender() {
+	VirtualClock clock;
+	EventLogOutput log(clock);
+	Sequencer sequencer;
+	sequencer.setTickSource(&clock);
+	sequencer.setOutput(&log);
+	sequencer.setSong(twoNoteSong());
+	sequencer.play(0);
+	clock.run();
+	check(sequencer.shouldStop(), "render ends after the last note-off");
+	check(clock.positionNs() == 1200000000, "virtual time follows the tempo map", clock.positionNs());
+	sequencer.stop();
+
+	const auto entries = log.entries();
+	check(entries.size() >= 4, "every note logged", static_cast<long long>(entries.size()));
+	if (entries.size() < 4) {
+		return;
+	}
+	check(logged(entries[0], 0, 0, MidiStatus::NoteOn, 60), "first note on");
+	check(logged(entries[1], 120, 480000000, MidiStatus::NoteOff, 60), "first note off");
+	check(logged(entries[2], 240, 960000000, MidiStatus::NoteOn, 64), "second note on");
+	check(logged(entries[3], 300, 1200000000, MidiStatus::NoteOff, 64), "second note off");
+
+	std::ostringstream out;
+	log.write(out);
+	std::string first;
+	std::getline(std::istringstream(out.str()), first);
+	check(first == "0 0 90 2 60 100 default", "log line format");
+}
+
+// Stepping the clock by hand visits only the ticks asked for.
+void testAdvanceTo() {
+	VirtualClock clock;
+	EventLogOutput log(clock);
+	Sequencer sequencer;
+	sequencer.setTickSource(&clock);
+	sequencer.setOutput(&log);
+	sequencer.setSong(twoNoteSong());
+	sequencer.play(0);
+	clock.advanceTo(200);
+	check(log.entries().size() == 2, "only ticks up to the position are processed",
+		static_cast<long long>(log.entries().size()));
+	check(clock.currentTick() == 200 && clock.positionNs() == 800000000, "position after advanceTo",
+		static_cast<long long>(clock.currentTick()));
+	check(!sequencer.shouldStop(), "playback still running mid-song");
+	sequencer.stop();
+}
+
+// Each log line ends with the client:port the message was routed to.
+void testDestinationInLog() {
+	VirtualClock clock;
+	EventLogOutput log(clock);
+	Sequencer sequencer;
+	sequencer.setTickSource(&clock);
+	sequencer.setOutput(&log);
+	Song song = twoNoteSong();
+	song.tracks[0].alsaClient = 20;
+	song.tracks[0].alsaPort = 1;
+	sequencer.setSong(song);
+	sequencer.play(0);
+	clock.run();
+	sequencer.stop();
+
+	std::ostringstream out;
+	log.write(out);
+	std::string first;
+	std::getline(std::istringstream(out.str()), first);
+	check(first == "0 0 90 2 60 100 20:1", "destination in log line");
+}
+
+} // namespace
+
+int main() {
+	testTwoNoteRender();
+	testAdvanceTo();
+	testDestinationInLog();
+	return finish("test_render");
+}